@@ -18,12 +18,21 @@
 
 #include "buffer.h"
 #include "xmalloc.h"
-#include "locking.h"
 #include "debug.h"
 
+#include <stdatomic.h>
+
 /*
- * chunk can be accessed by either consumer OR producer, not both at same time
- * -> no need to lock
+ * Single producer, single consumer ring of chunks.
+ *
+ * Chunks [ridx, widx) are filled and belong to the consumer, the rest to
+ * the producer. Only the producer moves widx and only the consumer moves
+ * ridx, so neither has to take a lock. Moving an index is a release store
+ * and the other thread loads it with acquire, which makes the contents of
+ * the chunk visible before the chunk changes hands.
+ *
+ * The indices count to 2 * buffer_nr_chunks so that a full ring (widx -
+ * ridx == buffer_nr_chunks) can be told apart from an empty one.
  */
 struct chunk {
 	char data[CHUNK_SIZE];
@@ -35,20 +44,29 @@ struct chunk {
 	 *
 	 * there are h - l bytes available (filled)
 	 */
-	unsigned int h : 31;
-
-	/* if chunk is marked filled it can only be accessed by consumer
-	 * otherwise only producer is allowed to access the chunk
-	 */
-	unsigned int filled : 1;
+	unsigned int h;
 };
 
 unsigned int buffer_nr_chunks;
 
-static pthread_mutex_t buffer_mutex = CMUS_MUTEX_INITIALIZER;
 static struct chunk *buffer_chunks = NULL;
-static unsigned int buffer_ridx;
-static unsigned int buffer_widx;
+static _Atomic unsigned int buffer_ridx;
+static _Atomic unsigned int buffer_widx;
+
+static inline unsigned int idx_next(unsigned int idx)
+{
+	return idx + 1 == 2 * buffer_nr_chunks ? 0 : idx + 1;
+}
+
+static inline unsigned int idx_distance(unsigned int r, unsigned int w)
+{
+	return w >= r ? w - r : 2 * buffer_nr_chunks - r + w;
+}
+
+static inline struct chunk *idx_chunk(unsigned int idx)
+{
+	return &buffer_chunks[idx < buffer_nr_chunks ? idx : idx - buffer_nr_chunks];
+}
 
 void buffer_init(void)
 {
@@ -68,21 +86,20 @@ void buffer_free(void)
  * Returns number of bytes available at @pos
  *
  * After reading bytes mark them consumed calling buffer_consume().
+ *
+ * Consumer only.
  */
 int buffer_get_rpos(char **pos)
 {
+	unsigned int r = atomic_load_explicit(&buffer_ridx, memory_order_relaxed);
+	unsigned int w = atomic_load_explicit(&buffer_widx, memory_order_acquire);
 	struct chunk *c;
-	int size = 0;
 
-	cmus_mutex_lock(&buffer_mutex);
-	c = &buffer_chunks[buffer_ridx];
-	if (c->filled) {
-		size = c->h - c->l;
-		*pos = c->data + c->l;
-	}
-	cmus_mutex_unlock(&buffer_mutex);
-
-	return size;
+	if (r == w)
+		return 0;
+	c = idx_chunk(r);
+	*pos = c->data + c->l;
+	return c->h - c->l;
 }
 
 /*
@@ -92,118 +109,77 @@ int buffer_get_rpos(char **pos)
  * non-zero it is guaranteed to be >= 1024.
  *
  * After writing bytes mark them filled calling buffer_fill().
+ *
+ * Producer only.
  */
 int buffer_get_wpos(char **pos)
 {
+	unsigned int w = atomic_load_explicit(&buffer_widx, memory_order_relaxed);
+	unsigned int r = atomic_load_explicit(&buffer_ridx, memory_order_acquire);
 	struct chunk *c;
-	int size = 0;
 
-	cmus_mutex_lock(&buffer_mutex);
-	c = &buffer_chunks[buffer_widx];
-	if (!c->filled) {
-		size = CHUNK_SIZE - c->h;
-		*pos = c->data + c->h;
-	}
-	cmus_mutex_unlock(&buffer_mutex);
-
-	return size;
+	if (idx_distance(r, w) == buffer_nr_chunks)
+		return 0;
+	c = idx_chunk(w);
+	*pos = c->data + c->h;
+	return CHUNK_SIZE - c->h;
 }
 
-void buffer_consume(int count)
+int buffer_consume(int count)
 {
+	unsigned int r = atomic_load_explicit(&buffer_ridx, memory_order_relaxed);
 	struct chunk *c;
 
 	BUG_ON(count < 0);
-	cmus_mutex_lock(&buffer_mutex);
-	c = &buffer_chunks[buffer_ridx];
-	BUG_ON(!c->filled);
+	BUG_ON(r == atomic_load_explicit(&buffer_widx, memory_order_relaxed));
+	c = idx_chunk(r);
 	c->l += count;
 	if (c->l == c->h) {
 		c->l = 0;
 		c->h = 0;
-		c->filled = 0;
-		buffer_ridx++;
-		buffer_ridx %= buffer_nr_chunks;
+		/* hand the chunk back to the producer */
+		atomic_store_explicit(&buffer_ridx, idx_next(r), memory_order_release);
+		return 1;
 	}
-	cmus_mutex_unlock(&buffer_mutex);
+	return 0;
 }
 
 /* chunk is marked filled if free bytes < 1024 or count == 0 */
 int buffer_fill(int count)
 {
+	unsigned int w = atomic_load_explicit(&buffer_widx, memory_order_relaxed);
 	struct chunk *c;
-	int filled = 0;
 
-	cmus_mutex_lock(&buffer_mutex);
-	c = &buffer_chunks[buffer_widx];
-	BUG_ON(c->filled);
+	BUG_ON(idx_distance(atomic_load_explicit(&buffer_ridx, memory_order_relaxed), w)
+			== buffer_nr_chunks);
+	c = idx_chunk(w);
 	c->h += count;
 
 	if (CHUNK_SIZE - c->h < 1024 || (count == 0 && c->h > 0)) {
-		c->filled = 1;
-		buffer_widx++;
-		buffer_widx %= buffer_nr_chunks;
-		filled = 1;
+		/* hand the chunk to the consumer */
+		atomic_store_explicit(&buffer_widx, idx_next(w), memory_order_release);
+		return 1;
 	}
-
-	cmus_mutex_unlock(&buffer_mutex);
-	return filled;
+	return 0;
 }
 
+/* neither the producer nor the consumer may use the buffer meanwhile */
 void buffer_reset(void)
 {
 	int i;
 
-	cmus_mutex_lock(&buffer_mutex);
-	buffer_ridx = 0;
-	buffer_widx = 0;
 	for (i = 0; i < buffer_nr_chunks; i++) {
 		buffer_chunks[i].l = 0;
 		buffer_chunks[i].h = 0;
-		buffer_chunks[i].filled = 0;
 	}
-	cmus_mutex_unlock(&buffer_mutex);
+	atomic_store_explicit(&buffer_ridx, 0, memory_order_release);
+	atomic_store_explicit(&buffer_widx, 0, memory_order_release);
 }
 
 int buffer_get_filled_chunks(void)
 {
-	int c;
-
-	cmus_mutex_lock(&buffer_mutex);
-	if (buffer_ridx < buffer_widx) {
-		/*
-		 * |__##########____|
-		 *    r         w
-		 *
-		 * |############____|
-		 *  r           w
-		 */
-		c = buffer_widx - buffer_ridx;
-	} else if (buffer_ridx > buffer_widx) {
-		/*
-		 * |#######______###|
-		 *         w     r
-		 *
-		 * |_____________###|
-		 *  w            r
-		 */
-		c = buffer_nr_chunks - buffer_ridx + buffer_widx;
-	} else {
-		/*
-		 * |################|
-		 *     r
-		 *     w
-		 *
-		 * |________________|
-		 *     r
-		 *     w
-		 */
-		if (buffer_chunks[buffer_ridx].filled) {
-			c = buffer_nr_chunks;
-		} else {
-			c = 0;
-		}
-	}
-	cmus_mutex_unlock(&buffer_mutex);
-	return c;
+	unsigned int r = atomic_load_explicit(&buffer_ridx, memory_order_acquire);
+	unsigned int w = atomic_load_explicit(&buffer_widx, memory_order_acquire);
+
+	return idx_distance(r, w);
 }
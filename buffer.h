@@ -39,7 +39,8 @@ void buffer_init(void);
 void buffer_free(void);
 int buffer_get_rpos(char **pos);
 int buffer_get_wpos(char **pos);
-void buffer_consume(int count);
+/* returns 1 if the chunk was emptied and handed back to the producer */
+int buffer_consume(int count);
 int buffer_fill(int count);
 void buffer_reset(void);
 int buffer_get_filled_chunks(void);
@@ -27,6 +27,10 @@
 #include "gbuf.h"
 #include "options.h"
 #include "pl_env.h"
+#include "debug.h"
+#include "hashtable.h"
+#include "u_collate.h"
+#include "stat_sweep.h"
 
 #include <stdlib.h>
 #include <stdio.h>
@@ -38,16 +42,23 @@
 #include <fcntl.h>
 #include <errno.h>
 #include <sys/mman.h>
+#include <pthread.h>
 
-#define CACHE_VERSION   0x0d
+#define CACHE_VERSION   0x0e
 
 #define CACHE_64_BIT	0x01
 #define CACHE_BE	0x02
 
 #define CACHE_RESERVED_PATTERN  	0xff
 
-#define CACHE_ENTRY_USED_SIZE		28
-#define CACHE_ENTRY_RESERVED_SIZE	52
+#define CACHE_ENTRY_USED_SIZE		40
+#define CACHE_ENTRY_RESERVED_SIZE	40
+
+// cache_entry.flags, only used in the journal
+#define CACHE_ENTRY_REMOVED		0x01
+
+// filename, codec, codec_profile and the collation keys
+#define CACHE_ENTRY_NR_STRINGS		(3 + TI_NR_COLLKEYS)
 #define CACHE_ENTRY_TOTAL_SIZE	(CACHE_ENTRY_RESERVED_SIZE + CACHE_ENTRY_USED_SIZE)
 
 // Cmus Track Cache version X + 4 bytes flags
@@ -64,11 +75,17 @@ struct cache_entry {
 	int32_t duration;
 	int32_t bitrate;
 	int32_t bpm;
+	uint32_t flags;
+	// collate_id() of the locale the collation keys were built in
+	uint32_t collate;
+	// bit N is set if collation key N is not NULL
+	uint32_t collkeys;
 
 	// when introducing new fields decrease the reserved space accordingly
 	uint8_t _reserved[CACHE_ENTRY_RESERVED_SIZE];
 
-	// filename, codec, codec_profile and N * (key, val)
+	// filename, codec, codec_profile, TI_NR_COLLKEYS collation keys
+	// and N * (key, val)
 	char strings[];
 };
 
@@ -78,23 +95,88 @@ STATIC_ASSERT(CACHE_ENTRY_TOTAL_SIZE == offsetof(struct cache_entry, strings));
 
 
 #define ALIGN(size) (((size) + sizeof(long) - 1) & ~(sizeof(long) - 1))
-#define HASH_SIZE 1023
+/* caches smaller than this per thread are decoded lazily on one thread */
+#define CACHE_LOAD_MIN_ENTRIES	4096
+#define CACHE_LOAD_MAX_THREADS	16
+/* compact when the journals are larger than this and take up this many percent */
+#define CACHE_JOURNAL_MIN_SIZE		(256 * 1024)
+#define CACHE_JOURNAL_MAX_GARBAGE	25
+
+/*
+ * Entry of the mmap'd cache file which has not been turned into a
+ * track_info yet. Entries are materialized on first lookup.
+ */
+struct lazy_entry {
+	const struct cache_entry *e;
+	/* points into the mapping unless the filename contains a pl_env var */
+	char *filename;
+	unsigned int hash;
+};
 
-static struct track_info *hash_table[HASH_SIZE];
+/* track_infos, keyed by filename */
+static struct hashtable hash_table = HASHTABLE_INIT;
+/* lazy_entries which have not been materialized */
+static struct hashtable lazy_table = HASHTABLE_INIT;
 static char *cache_filename;
-static int total;
+/* u_collate_id() when the cache was loaded */
+static uint32_t collate_id;
+
+/*
+ * A file that has been mapped is never truncated or modified in place.
+ * The cache file and the journals are replaced with rename() or unlinked
+ * before a new one is created, so the mappings stay valid until we exit.
+ * Materialized track_infos point into them.
+ */
+static struct lazy_entry *lazy_entries;
+static int nr_lazy_entries;
 
 struct fifo_mutex cache_mutex = FIFO_MUTEX_INITIALIZER;
 
+/*
+ * Changes are appended to the journal as they happen instead of writing
+ * the whole cache on exit. read_cache() replays it on top of the cache
+ * file.
+ *
+ * Compaction renames the journal to cache.journal.old, writes a new
+ * cache file in the background and then removes the old journal.
+ * Changes made meanwhile go to a new journal. If we die before the old
+ * journal is removed both are replayed, which is harmless because the
+ * new cache file already contains everything in the old journal.
+ */
+static char *journal_filename;
+static char *old_journal_filename;
+static int journal_fd = -1;
+static unsigned int journal_size;
+static unsigned int old_journal_size;
+static unsigned int base_size;
+static int compacting;
+static int compact_disabled;
+static int compact_thread_started;
+static pthread_t compact_thread;
+/* protects everything above, nests inside cache_mutex */
+static pthread_mutex_t journal_mutex = CMUS_MUTEX_INITIALIZER;
+
+static void journal_add_ti(struct track_info *ti);
+static void journal_remove(const char *filename);
+
+
+static bool ti_filename_eq(const void *ptr, const void *key)
+{
+	const struct track_info *ti = ptr;
+
+	return !strcmp(ti->filename, key);
+}
+
+static bool lazy_entry_filename_eq(const void *ptr, const void *key)
+{
+	const struct lazy_entry *le = ptr;
+
+	return !strcmp(le->filename, key);
+}
 
 static void add_ti(struct track_info *ti, unsigned int hash)
 {
-	unsigned int pos = hash % HASH_SIZE;
-	struct track_info *next = hash_table[pos];
-
-	ti->next = next;
-	hash_table[pos] = ti;
-	total++;
+	hashtable_insert(&hash_table, hash, ti);
 }
 
 static int valid_cache_entry(const struct cache_entry *e, unsigned int avail)
@@ -115,42 +197,36 @@ static int valid_cache_entry(const struct cache_entry *e, unsigned int avail)
 		if (!e->strings[i])
 			count++;
 	}
-	if (count % 2 == 0)
+	if (count < CACHE_ENTRY_NR_STRINGS || count % 2 == 0)
 		return 0;
 	if (e->strings[str_size - 1])
 		return 0;
 	return 1;
 }
 
-static struct track_info *cache_entry_to_ti(struct cache_entry *e)
+static struct track_info *cache_entry_to_ti(const struct cache_entry *e, const char *filename)
 {
 	const char *strings = e->strings;
+	const char *collkeys[TI_NR_COLLKEYS];
 	struct track_info *ti;
 	struct keyval *kv;
 	int str_size = e->size - sizeof(*e);
 	int pos, i, count;
-	char *proc_filename;
-
-	if (pl_env_var(strings, NULL) && (proc_filename = pl_env_expand(strings))) {
-		ti = track_info_new(proc_filename);
-		free(proc_filename);
-	} else {
-		ti = track_info_new(strings);
-	}
 
+	ti = track_info_new(filename);
 	ti->duration = e->duration;
 	ti->bitrate = e->bitrate;
 	ti->mtime = e->mtime;
 	ti->play_count = e->play_count;
 	ti->bpm = e->bpm;
 
-	// count strings (filename + codec + codec_profile + key/val pairs)
+	// count strings (filename + codec + codec_profile + collkeys + key/val pairs)
 	count = 0;
 	for (i = 0; i < str_size; i++) {
 		if (!strings[i])
 			count++;
 	}
-	count = (count - 3) / 2;
+	count = (count - CACHE_ENTRY_NR_STRINGS) / 2;
 
 	// NOTE: filename already copied by track_info_new()
 	pos = strlen(strings) + 1;
@@ -158,56 +234,81 @@ static struct track_info *cache_entry_to_ti(struct cache_entry *e)
 	pos += strlen(strings + pos) + 1;
 	ti->codec_profile = strings[pos] ? xstrdup(strings + pos) : NULL;
 	pos += strlen(strings + pos) + 1;
+	for (i = 0; i < TI_NR_COLLKEYS; i++) {
+		collkeys[i] = e->collkeys & (1U << i) ? strings + pos : NULL;
+		pos += strlen(strings + pos) + 1;
+	}
+
+	// keys and values are used straight from the mapping
 	kv = xnew(struct keyval, count + 1);
 	for (i = 0; i < count; i++) {
-		int size;
-
-		size = strlen(strings + pos) + 1;
-		kv[i].key = xstrdup(strings + pos);
-		pos += size;
+		kv[i].key = (char *)strings + pos;
+		pos += strlen(strings + pos) + 1;
 
-		size = strlen(strings + pos) + 1;
-		kv[i].val = xstrdup(strings + pos);
-		pos += size;
+		kv[i].val = (char *)strings + pos;
+		pos += strlen(strings + pos) + 1;
 	}
 	kv[i].key = NULL;
 	kv[i].val = NULL;
-	track_info_set_comments(ti, kv);
+	ti->comments_mapped = 1;
+	// keys built in another locale are recomputed and written back later
+	if (e->collate == collate_id)
+		track_info_set_comments_collkeys(ti, kv, collkeys);
+	else
+		track_info_set_comments(ti, kv);
 	return ti;
 }
 
-struct track_info *lookup_cache_entry(const char *filename, unsigned int hash)
+static struct track_info *materialize_lazy_entry(struct lazy_entry *le)
+{
+	struct track_info *ti = cache_entry_to_ti(le->e, le->filename);
+
+	hashtable_remove(&lazy_table, le->hash, le);
+	add_ti(ti, le->hash);
+	if (le->filename != le->e->strings)
+		free(le->filename);
+	le->filename = NULL;
+	le->e = NULL;
+	return ti;
+}
+
+static struct track_info *lookup_lazy_entry(const char *filename, unsigned int hash)
+{
+	struct lazy_entry *le;
+
+	le = hashtable_find(&lazy_table, hash, lazy_entry_filename_eq, filename);
+	return le ? materialize_lazy_entry(le) : NULL;
+}
+
+static void materialize_all(void)
 {
-	struct track_info *ti = hash_table[hash % HASH_SIZE];
+	int i;
+
+	if (!hashtable_count(&lazy_table))
+		return;
 
-	while (ti) {
-		if (!strcmp(filename, ti->filename))
-			return ti;
-		ti = ti->next;
+	for (i = 0; i < nr_lazy_entries; i++) {
+		if (lazy_entries[i].e)
+			materialize_lazy_entry(&lazy_entries[i]);
 	}
-	return NULL;
+	hashtable_clear(&lazy_table);
+}
+
+struct track_info *lookup_cache_entry(const char *filename, unsigned int hash)
+{
+	struct track_info *ti;
+
+	ti = hashtable_find(&hash_table, hash, ti_filename_eq, filename);
+	if (ti)
+		return ti;
+	return lookup_lazy_entry(filename, hash);
 }
 
 static void do_cache_remove_ti(struct track_info *ti, unsigned int hash)
 {
-	unsigned int pos = hash % HASH_SIZE;
-	struct track_info *t = hash_table[pos];
-	struct track_info *next, *prev = NULL;
-
-	while (t) {
-		next = t->next;
-		if (t == ti) {
-			if (prev) {
-				prev->next = next;
-			} else {
-				hash_table[pos] = next;
-			}
-			total--;
-			track_info_unref(ti);
-			return;
-		}
-		prev = t;
-		t = next;
+	if (hashtable_remove(&hash_table, hash, ti)) {
+		journal_remove(ti->filename);
+		track_info_unref(ti);
 	}
 }
 
@@ -216,59 +317,453 @@ void cache_remove_ti(struct track_info *ti)
 	do_cache_remove_ti(ti, hash_str(ti->filename));
 }
 
-static int read_cache(void)
+/* returns e->strings or a new string if the filename contains a pl_env var */
+static char *cache_entry_filename(const struct cache_entry *e)
+{
+	char *filename = (char *)e->strings;
+	char *proc_filename;
+
+	if (pl_env_var(filename, NULL) && (proc_filename = pl_env_expand(filename)))
+		return proc_filename;
+	return filename;
+}
+
+static void add_lazy_entry(const struct cache_entry *e)
+{
+	char *filename = cache_entry_filename(e);
+	struct lazy_entry *le;
+
+	if (nr_lazy_entries % 1024 == 0)
+		lazy_entries = xrenew(struct lazy_entry, lazy_entries, nr_lazy_entries + 1024);
+	le = &lazy_entries[nr_lazy_entries++];
+	le->e = e;
+	le->filename = filename;
+	le->hash = hash_str(filename);
+}
+
+static void link_lazy_entries(void)
+{
+	int i;
+
+	// entries don't move anymore
+	for (i = 0; i < nr_lazy_entries; i++)
+		hashtable_insert(&lazy_table, lazy_entries[i].hash, &lazy_entries[i]);
+}
+
+struct cache_loader {
+	pthread_t thread;
+	const struct cache_entry **entries;
+	struct track_info **tis;
+	unsigned int *hashes;
+	int count;
+	int corrupt;
+};
+
+static void *cache_loader_thread(void *data)
+{
+	struct cache_loader *l = data;
+	int i;
+
+	for (i = 0; i < l->count; i++) {
+		const struct cache_entry *e = l->entries[i];
+		char *filename;
+
+		if (!valid_cache_entry(e, e->size)) {
+			l->corrupt = 1;
+			break;
+		}
+
+		filename = cache_entry_filename(e);
+		l->tis[i] = cache_entry_to_ti(e, filename);
+		l->hashes[i] = hash_str(l->tis[i]->filename);
+		if (filename != e->strings)
+			free(filename);
+	}
+	/* number of track_infos created */
+	l->count = i;
+	return NULL;
+}
+
+/*
+ * Decodes entries on @nr_threads threads. Each thread gets a contiguous
+ * range of @entries, the results are added to the hash table in file
+ * order afterwards.
+ */
+static int load_entries_parallel(const struct cache_entry **entries, int count,
+		int nr_threads)
+{
+	struct cache_loader loaders[CACHE_LOAD_MAX_THREADS];
+	struct track_info **tis = xnew(struct track_info *, count);
+	unsigned int *hashes = xnew(unsigned int, count);
+	int i, j, pos = 0, corrupt = 0;
+	uint64_t t = timer_get();
+
+	for (i = 0; i < nr_threads; i++) {
+		struct cache_loader *l = &loaders[i];
+		int n = count / nr_threads + (i < count % nr_threads);
+		int rc;
+
+		l->entries = entries + pos;
+		l->tis = tis + pos;
+		l->hashes = hashes + pos;
+		l->count = n;
+		l->corrupt = 0;
+		pos += n;
+
+		rc = pthread_create(&l->thread, NULL, cache_loader_thread, l);
+		BUG_ON(rc);
+	}
+	for (i = 0; i < nr_threads; i++) {
+		pthread_join(loaders[i].thread, NULL);
+		corrupt |= loaders[i].corrupt;
+	}
+	timer_print("cache decode", timer_get() - t);
+
+	t = timer_get();
+	for (i = 0; i < nr_threads; i++) {
+		struct cache_loader *l = &loaders[i];
+
+		for (j = 0; j < l->count; j++) {
+			if (corrupt)
+				track_info_unref(l->tis[j]);
+			else
+				add_ti(l->tis[j], l->hashes[j]);
+		}
+	}
+	timer_print("cache merge", timer_get() - t);
+
+	free(hashes);
+	free(tis);
+	return corrupt ? -1 : 0;
+}
+
+static int load_entries_lazy(const struct cache_entry **entries, int count)
+{
+	uint64_t t = timer_get();
+	int i;
+
+	for (i = 0; i < count; i++) {
+		if (!valid_cache_entry(entries[i], entries[i]->size))
+			goto corrupt;
+		add_lazy_entry(entries[i]);
+	}
+	link_lazy_entries();
+	timer_print("cache index", timer_get() - t);
+	return 0;
+corrupt:
+	while (nr_lazy_entries > 0) {
+		struct lazy_entry *le = &lazy_entries[--nr_lazy_entries];
+
+		if (le->filename != le->e->strings)
+			free(le->filename);
+	}
+	free(lazy_entries);
+	lazy_entries = NULL;
+	return -1;
+}
+
+struct entry_list {
+	const struct cache_entry **entries;
+	int count;
+	int alloc;
+};
+
+static void entry_list_reserve(struct entry_list *l, int count)
+{
+	if (count > l->alloc) {
+		l->alloc = (count + 1023) & ~1023;
+		l->entries = xrenew(const struct cache_entry *, l->entries, l->alloc);
+	}
+}
+
+static void entry_list_add(struct entry_list *l, const struct cache_entry *e)
+{
+	entry_list_reserve(l, l->count + 1);
+	l->entries[l->count++] = e;
+}
+
+/*
+ * Maps @filename and checks its header. Sets *bufp to NULL if the file
+ * does not exist. Returns -1 on error and -2 if the file is corrupt.
+ */
+static int map_cache_file(const char *filename, char **bufp, unsigned int *sizep)
 {
-	unsigned int size, offset = 0;
 	struct stat st = {};
 	char *buf;
 	int fd;
 
-	fd = open(cache_filename, O_RDONLY);
+	*bufp = NULL;
+	*sizep = 0;
+	fd = open(filename, O_RDONLY);
 	if (fd < 0) {
 		if (errno == ENOENT)
 			return 0;
 		return -1;
 	}
 	fstat(fd, &st);
-	if (st.st_size < sizeof(cache_header))
-		goto close;
-	size = st.st_size;
-
-	buf = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
-	if (buf == MAP_FAILED) {
+	if (st.st_size < sizeof(cache_header)) {
 		close(fd);
+		return -2;
+	}
+
+	buf = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (buf == MAP_FAILED)
 		return -1;
+
+	if (memcmp(buf, cache_header, sizeof(cache_header))) {
+		munmap(buf, st.st_size);
+		return -2;
 	}
+	*bufp = buf;
+	*sizep = st.st_size;
+	return 0;
+}
 
-	if (memcmp(buf, cache_header, sizeof(cache_header)))
-		goto corrupt;
+/*
+ * Adds the records of a journal to @l. Everything after the first invalid
+ * record is ignored, it is what remains of an interrupted write. Sets
+ * *sizep to the length of the valid part.
+ */
+static void read_journal(const char *filename, struct entry_list *l, unsigned int *sizep)
+{
+	unsigned int size, offset;
+	char *buf;
+
+	*sizep = 0;
+	if (map_cache_file(filename, &buf, &size) || !buf)
+		return;
 
 	offset = sizeof(cache_header);
 	while (offset < size) {
-		struct cache_entry *e = (void *)(buf + offset);
-		struct track_info *ti;
+		const struct cache_entry *e = (void *)(buf + offset);
 
 		if (!valid_cache_entry(e, size - offset))
+			break;
+		entry_list_add(l, e);
+		offset += e->size;
+		if (offset < size)
+			offset = ALIGN(offset);
+	}
+	*sizep = offset;
+}
+
+static bool entry_slot_filename_eq(const void *ptr, const void *key)
+{
+	const struct cache_entry * const *slot = ptr;
+
+	return !strcmp((*slot)->strings, key);
+}
+
+/*
+ * Applies journal records in @journal to the cache file entries in @l.
+ * Entries are matched by the filename as stored in the file.
+ */
+static int replay_journal(struct entry_list *l, const struct entry_list *journal)
+{
+	struct hashtable slots = HASHTABLE_INIT;
+	int i, n;
+
+	// slots must not move
+	entry_list_reserve(l, l->count + journal->count);
+	for (i = 0; i < l->count; i++) {
+		const struct cache_entry *e = l->entries[i];
+
+		if (!valid_cache_entry(e, e->size)) {
+			hashtable_clear(&slots);
+			return -1;
+		}
+		hashtable_insert(&slots, hash_str(e->strings), &l->entries[i]);
+	}
+
+	for (i = 0; i < journal->count; i++) {
+		const struct cache_entry *e = journal->entries[i];
+		unsigned int hash = hash_str(e->strings);
+		const struct cache_entry **slot;
+
+		slot = hashtable_find(&slots, hash, entry_slot_filename_eq, e->strings);
+		if (e->flags & CACHE_ENTRY_REMOVED) {
+			if (slot) {
+				hashtable_remove(&slots, hash, slot);
+				*slot = NULL;
+			}
+		} else if (slot) {
+			*slot = e;
+		} else {
+			slot = &l->entries[l->count++];
+			*slot = e;
+			hashtable_insert(&slots, hash, slot);
+		}
+	}
+	hashtable_clear(&slots);
+
+	for (i = n = 0; i < l->count; i++) {
+		if (l->entries[i])
+			l->entries[n++] = l->entries[i];
+	}
+	l->count = n;
+	return 0;
+}
+
+static int read_cache(void)
+{
+	struct entry_list entries = {}, journal = {};
+	unsigned int size, offset;
+	char *buf;
+	int nr_threads, rc;
+	uint64_t t;
+
+	rc = map_cache_file(cache_filename, &buf, &size);
+	if (rc)
+		return rc;
+
+	// find entry boundaries, the contents are validated by the loaders
+	t = timer_get();
+	offset = sizeof(cache_header);
+	while (offset < size) {
+		const struct cache_entry *e = (void *)(buf + offset);
+		unsigned int avail = size - offset;
+
+		if (avail < sizeof(*e) || e->size < sizeof(*e) || e->size > avail)
 			goto corrupt;
 
-		ti = cache_entry_to_ti(e);
-		add_ti(ti, hash_str(ti->filename));
+		entry_list_add(&entries, e);
 		offset += ALIGN(e->size);
 	}
-	munmap(buf, size);
-	close(fd);
+	base_size = size;
+	timer_print("cache scan", timer_get() - t);
+
+	read_journal(old_journal_filename, &journal, &old_journal_size);
+	read_journal(journal_filename, &journal, &journal_size);
+	if (journal.count) {
+		t = timer_get();
+		rc = replay_journal(&entries, &journal);
+		free(journal.entries);
+		if (rc)
+			goto corrupt;
+		timer_print("cache replay", timer_get() - t);
+	}
+
+	nr_threads = min_i(get_nr_cpus(), CACHE_LOAD_MAX_THREADS);
+	nr_threads = min_i(nr_threads, entries.count / CACHE_LOAD_MIN_ENTRIES);
+	if (nr_threads > 1) {
+		d_print("decoding %d cache entries on %d threads\n", entries.count, nr_threads);
+		rc = load_entries_parallel(entries.entries, entries.count, nr_threads);
+	} else {
+		rc = load_entries_lazy(entries.entries, entries.count);
+	}
+	if (rc)
+		goto corrupt;
+
+	free(entries.entries);
 	return 0;
 corrupt:
-	munmap(buf, size);
-close:
-	close(fd);
-	// corrupt
+	// the journals are left mapped, they are thrown away anyway
+	free(entries.entries);
+	if (buf)
+		munmap(buf, size);
 	return -2;
 }
 
+/* copies @in from @offset up to @end to the end of @out */
+static int copy_range(int out, int in, unsigned int offset, unsigned int end)
+{
+	char buf[16 * 1024];
+
+	if (lseek(in, offset, SEEK_SET) < 0)
+		return -1;
+	while (offset < end) {
+		unsigned int n = min_u(sizeof(buf), end - offset);
+
+		if (read_all(in, buf, n) != n || write_all(out, buf, n) < 0)
+			return -1;
+		offset += n;
+	}
+	return 0;
+}
+
+/*
+ * Replaces the journal @filename with its first @size bytes, followed by
+ * the records of the journal @append if it is not NULL. Everything else
+ * in the file is what remains of an interrupted write. *sizep is set to
+ * the size of the new file.
+ */
+static int rewrite_journal(const char *filename, unsigned int size,
+		const char *append, unsigned int append_size, unsigned int *sizep)
+{
+	static const char zeros[sizeof(long)];
+	unsigned int new_size = size;
+	int in, out, rc = -1;
+	char *tmp;
+
+	in = open(filename, O_RDONLY);
+	if (in < 0)
+		return -1;
+	tmp = xstrjoin(filename, ".tmp");
+	out = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+	if (out < 0)
+		goto close_in;
+
+	if (copy_range(out, in, 0, size))
+		goto close_out;
+	if (append) {
+		close(in);
+		in = open(append, O_RDONLY);
+		if (in < 0)
+			goto close_out;
+		// records are aligned relative to the start of the file
+		new_size = ALIGN(size);
+		if (write_all(out, zeros, new_size - size) < 0 ||
+				copy_range(out, in, sizeof(cache_header), append_size))
+			goto close_out;
+		new_size += append_size - sizeof(cache_header);
+	}
+	rc = 0;
+close_out:
+	close(out);
+	if (!rc)
+		rc = rename(tmp, filename);
+	if (rc)
+		unlink(tmp);
+	else
+		*sizep = new_size;
+close_in:
+	if (in >= 0)
+		close(in);
+	free(tmp);
+	return rc;
+}
+
+/* starts a new journal if journal_size is 0 */
+static void open_journal(void)
+{
+	if (journal_size) {
+		journal_fd = open(journal_filename, O_WRONLY | O_APPEND);
+		if (journal_fd < 0)
+			d_print("open %s: %s\n", journal_filename, strerror(errno));
+		return;
+	}
+
+	// the old one may still be mapped
+	unlink(journal_filename);
+	journal_fd = open(journal_filename, O_WRONLY | O_CREAT | O_EXCL | O_APPEND, 0666);
+	if (journal_fd < 0) {
+		d_print("open %s: %s\n", journal_filename, strerror(errno));
+		return;
+	}
+	if (write_all(journal_fd, cache_header, sizeof(cache_header)) < 0) {
+		d_print("%s: %s\n", journal_filename, strerror(errno));
+		close(journal_fd);
+		journal_fd = -1;
+		return;
+	}
+	journal_size = sizeof(cache_header);
+}
+
 int cache_init(void)
 {
 	unsigned int flags = 0;
+	int rc;
 
 #ifdef WORDS_BIGENDIAN
 	flags |= CACHE_BE;
@@ -284,8 +779,32 @@ int cache_init(void)
 	/* assumed version */
 	cache_header[3] = CACHE_VERSION;
 
+	collate_id = u_collate_id();
 	cache_filename = xstrjoin(cmus_config_dir, "/cache");
-	return read_cache();
+	journal_filename = xstrjoin(cmus_config_dir, "/cache.journal");
+	old_journal_filename = xstrjoin(cmus_config_dir, "/cache.journal.old");
+	rc = read_cache();
+	if (rc == -2) {
+		// the journals are useless without the cache they apply to
+		unlink(cache_filename);
+		base_size = 0;
+		old_journal_size = 0;
+		journal_size = 0;
+	}
+	if (!old_journal_size)
+		unlink(old_journal_filename);
+	if (journal_size) {
+		struct stat st;
+
+		// cut off what remains of an interrupted write
+		if (stat(journal_filename, &st) == 0 && st.st_size != journal_size &&
+				rewrite_journal(journal_filename, journal_size, NULL, 0, &journal_size)) {
+			d_print("%s: %s\n", journal_filename, strerror(errno));
+			return rc;
+		}
+	}
+	open_journal();
+	return rc;
 }
 
 static int ti_filename_cmp(const void *a, const void *b)
@@ -298,20 +817,18 @@ static int ti_filename_cmp(const void *a, const void *b)
 
 static struct track_info **get_track_infos(bool reference)
 {
+	struct hashtable_iter iter;
 	struct track_info **tis;
-	int i, c;
+	struct track_info *ti;
+	int c, total = hashtable_count(&hash_table);
 
 	tis = xnew(struct track_info *, total);
 	c = 0;
-	for (i = 0; i < HASH_SIZE; i++) {
-		struct track_info *ti = hash_table[i];
-
-		while (ti) {
-			if (reference)
-				track_info_ref(ti);
-			tis[c++] = ti;
-			ti = ti->next;
-		}
+	hashtable_iter_init(&iter, &hash_table);
+	while ((ti = hashtable_iter_next(&iter))) {
+		if (reference)
+			track_info_ref(ti);
+		tis[c++] = ti;
 	}
 	qsort(tis, total, sizeof(struct track_info *), ti_filename_cmp);
 	return tis;
@@ -329,12 +846,19 @@ static void write_ti(int fd, struct gbuf *buf, struct track_info *ti, unsigned i
 {
 	char *proc_filename = pl_env_reduce(ti->filename);
 	const struct keyval *kv = ti->comments;
+	const char *collkeys[TI_NR_COLLKEYS] = {
+		ti->collkey_artist, ti->collkey_album, ti->collkey_title,
+		ti->collkey_genre, ti->collkey_comment, ti->collkey_albumartist
+	};
 	unsigned int offset = *offsetp;
 	unsigned int pad;
 	struct cache_entry e;
 	int *len, alloc = 64, count, i;
 
 	memset(e._reserved, CACHE_RESERVED_PATTERN, sizeof(e._reserved));
+	e.flags = 0;
+	e.collate = collate_id;
+	e.collkeys = 0;
 
 	count = 0;
 	len = xnew(int, alloc);
@@ -350,6 +874,12 @@ static void write_ti(int fd, struct gbuf *buf, struct track_info *ti, unsigned i
 	e.size += len[count++];
 	len[count] = (ti->codec_profile ? strlen(ti->codec_profile) : 0) + 1;
 	e.size += len[count++];
+	for (i = 0; i < TI_NR_COLLKEYS; i++) {
+		if (collkeys[i])
+			e.collkeys |= 1U << i;
+		len[count] = (collkeys[i] ? strlen(collkeys[i]) : 0) + 1;
+		e.size += len[count++];
+	}
 	for (i = 0; kv[i].key; i++) {
 		if (count + 2 > alloc) {
 			alloc *= 2;
@@ -372,6 +902,8 @@ static void write_ti(int fd, struct gbuf *buf, struct track_info *ti, unsigned i
 	gbuf_add_bytes(buf, proc_filename, len[count++]);
 	gbuf_add_bytes(buf, ti->codec ? ti->codec : "", len[count++]);
 	gbuf_add_bytes(buf, ti->codec_profile ? ti->codec_profile : "", len[count++]);
+	for (i = 0; i < TI_NR_COLLKEYS; i++)
+		gbuf_add_bytes(buf, collkeys[i] ? collkeys[i] : "", len[count++]);
 	for (i = 0; kv[i].key; i++) {
 		gbuf_add_bytes(buf, kv[i].key, len[count++]);
 		gbuf_add_bytes(buf, kv[i].val, len[count++]);
@@ -383,10 +915,48 @@ static void write_ti(int fd, struct gbuf *buf, struct track_info *ti, unsigned i
 	free(proc_filename);
 }
 
-int cache_close(void)
+static void write_cache_entry(int fd, struct gbuf *buf, const struct cache_entry *e,
+		unsigned int *offsetp)
+{
+	unsigned int offset = *offsetp;
+	unsigned int pad = ALIGN(offset) - offset;
+
+	if (gbuf_avail(buf) < pad + e->size)
+		flush_buffer(fd, buf);
+
+	if (pad)
+		gbuf_set(buf, 0, pad);
+	gbuf_add_bytes(buf, e, e->size);
+	*offsetp = offset + pad + e->size;
+}
+
+static void write_removed(struct gbuf *buf, const char *filename, unsigned int *offsetp)
+{
+	char *proc_filename = pl_env_reduce(filename);
+	unsigned int offset = *offsetp;
+	unsigned int pad = ALIGN(offset) - offset;
+	struct cache_entry e = {};
+
+	memset(e._reserved, CACHE_RESERVED_PATTERN, sizeof(e._reserved));
+	e.flags = CACHE_ENTRY_REMOVED;
+	// filename followed by empty strings
+	e.size = sizeof(e) + strlen(proc_filename) + CACHE_ENTRY_NR_STRINGS;
+
+	if (pad)
+		gbuf_set(buf, 0, pad);
+	gbuf_add_bytes(buf, &e, sizeof(e));
+	gbuf_add_bytes(buf, proc_filename, strlen(proc_filename) + 1);
+	gbuf_set(buf, 0, CACHE_ENTRY_NR_STRINGS - 1);
+	*offsetp = offset + pad + e.size;
+
+	free(proc_filename);
+}
+
+/* writes a new cache file, *sizep is set to its size */
+static int write_cache(struct track_info **tis, int nr_tis,
+		const struct cache_entry **entries, int nr_entries, unsigned int *sizep)
 {
 	GBUF(buf);
-	struct track_info **tis;
 	unsigned int offset;
 	int i, fd, rc;
 	char *tmp;
@@ -398,20 +968,228 @@ int cache_close(void)
 		return -1;
 	}
 
-	tis = get_track_infos(false);
-
 	gbuf_grow(&buf, 64 * 1024 - 1);
 	gbuf_add_bytes(&buf, cache_header, sizeof(cache_header));
 	offset = sizeof(cache_header);
-	for (i = 0; i < total; i++)
+	for (i = 0; i < nr_tis; i++) {
+		// metadata_changed() replaces the comments of a playing stream
+		cache_lock();
 		write_ti(fd, &buf, tis[i], &offset);
+		cache_unlock();
+	}
+
+	// entries nobody asked for are copied verbatim from the old file
+	for (i = 0; i < nr_entries; i++)
+		write_cache_entry(fd, &buf, entries[i], &offset);
 	flush_buffer(fd, &buf);
 	gbuf_free(&buf);
-	free(tis);
 
 	close(fd);
 	rc = rename(tmp, cache_filename);
 	free(tmp);
+	*sizep = offset;
+	return rc;
+}
+
+/*
+ * Everything in the journals becomes garbage when the cache is compacted,
+ * and all of it has to be replayed on startup until then.
+ */
+static int need_compaction(void)
+{
+	uint64_t garbage = journal_size + old_journal_size;
+
+	return garbage >= CACHE_JOURNAL_MIN_SIZE &&
+		garbage * 100 >= (base_size + garbage) * CACHE_JOURNAL_MAX_GARBAGE;
+}
+
+/* starts a new journal, the current one becomes the old journal */
+static int rotate_journal(void)
+{
+	if (journal_fd < 0)
+		return 0;
+
+	if (old_journal_size) {
+		// an earlier compaction failed
+		if (rewrite_journal(old_journal_filename, old_journal_size,
+					journal_filename, journal_size, &old_journal_size))
+			return -1;
+	} else {
+		if (rename(journal_filename, old_journal_filename))
+			return -1;
+		old_journal_size = journal_size;
+	}
+
+	close(journal_fd);
+	journal_size = 0;
+	open_journal();
+	return 0;
+}
+
+/*
+ * Writes everything to a new cache file and throws the old journal away.
+ * The cache is locked while taking the snapshot and while each track_info
+ * is serialized, not for the whole write.
+ */
+static int compact_cache(void)
+{
+	const struct cache_entry **entries;
+	struct track_info **tis;
+	int nr_tis, nr_entries = 0, i, rc;
+	unsigned int size;
+	uint64_t t = timer_get();
+
+	cache_lock();
+	nr_tis = hashtable_count(&hash_table);
+	tis = get_track_infos(true);
+	entries = xnew(const struct cache_entry *, hashtable_count(&lazy_table) + 1);
+	for (i = 0; i < nr_lazy_entries; i++) {
+		if (lazy_entries[i].e)
+			entries[nr_entries++] = lazy_entries[i].e;
+	}
+	cmus_mutex_lock(&journal_mutex);
+	rc = rotate_journal();
+	cmus_mutex_unlock(&journal_mutex);
+	cache_unlock();
+
+	if (!rc)
+		rc = write_cache(tis, nr_tis, entries, nr_entries, &size);
+	if (!rc) {
+		cmus_mutex_lock(&journal_mutex);
+		unlink(old_journal_filename);
+		old_journal_size = 0;
+		base_size = size;
+		cmus_mutex_unlock(&journal_mutex);
+	} else {
+		d_print("compacting cache failed: %s\n", strerror(errno));
+	}
+
+	for (i = 0; i < nr_tis; i++)
+		track_info_unref(tis[i]);
+	free(tis);
+	free(entries);
+	timer_print("cache compaction", timer_get() - t);
+	return rc;
+}
+
+static void *compact_thread_func(void *arg)
+{
+	int rc = compact_cache();
+
+	cmus_mutex_lock(&journal_mutex);
+	// don't try again until exit
+	if (rc)
+		compact_disabled = 1;
+	compacting = 0;
+	cmus_mutex_unlock(&journal_mutex);
+	return NULL;
+}
+
+/* journal_mutex must be locked */
+static void maybe_start_compaction(void)
+{
+	if (compacting || compact_disabled || !need_compaction())
+		return;
+
+	// the previous thread has finished or is about to
+	if (compact_thread_started)
+		pthread_join(compact_thread, NULL);
+	compacting = 1;
+	compact_thread_started = !pthread_create(&compact_thread, NULL, compact_thread_func, NULL);
+	if (!compact_thread_started)
+		compacting = 0;
+}
+
+/* journal_mutex must be locked */
+static void journal_write(struct gbuf *buf, unsigned int offset)
+{
+	if (write_all(journal_fd, buf->buffer, buf->len) < 0) {
+		d_print("%s: %s\n", journal_filename, strerror(errno));
+		/*
+		 * don't leave a partial record in front of the next one, only
+		 * what we just wrote is cut off and that has not been mapped
+		 */
+		if (ftruncate(journal_fd, journal_size)) {
+			close(journal_fd);
+			journal_fd = -1;
+		}
+		return;
+	}
+	journal_size = offset;
+	maybe_start_compaction();
+}
+
+static void journal_add_ti(struct track_info *ti)
+{
+	GBUF(buf);
+	unsigned int offset;
+
+	cmus_mutex_lock(&journal_mutex);
+	if (journal_fd >= 0) {
+		offset = journal_size;
+		write_ti(journal_fd, &buf, ti, &offset);
+		journal_write(&buf, offset);
+	}
+	cmus_mutex_unlock(&journal_mutex);
+	gbuf_free(&buf);
+}
+
+static void journal_remove(const char *filename)
+{
+	GBUF(buf);
+	unsigned int offset;
+
+	cmus_mutex_lock(&journal_mutex);
+	if (journal_fd >= 0) {
+		offset = journal_size;
+		write_removed(&buf, filename, &offset);
+		journal_write(&buf, offset);
+	}
+	cmus_mutex_unlock(&journal_mutex);
+	gbuf_free(&buf);
+}
+
+void cache_update_ti(struct track_info *ti)
+{
+	struct track_info *cur;
+
+	if (pl_env_var(ti->filename, NULL))
+		return;
+
+	cache_lock();
+	/*
+	 * @ti may have been removed or replaced by a newer version since it
+	 * was looked up. Journaling it then would resurrect a removed file or
+	 * override the newer entry on the next start.
+	 */
+	cur = hashtable_find(&hash_table, hash_str(ti->filename), ti_filename_eq, ti->filename);
+	if (cur) {
+		cur->play_count = ti->play_count;
+		journal_add_ti(cur);
+	}
+	cache_unlock();
+}
+
+int cache_close(void)
+{
+	int rc = 0, started;
+
+	cmus_mutex_lock(&journal_mutex);
+	compact_disabled = 1;
+	started = compact_thread_started;
+	compact_thread_started = 0;
+	cmus_mutex_unlock(&journal_mutex);
+	if (started)
+		pthread_join(compact_thread, NULL);
+
+	// without a journal the changes are only in memory
+	if (journal_fd < 0 || need_compaction())
+		rc = compact_cache();
+
+	if (journal_fd >= 0) {
+		close(journal_fd);
+		journal_fd = -1;
+	}
 	return rc;
 }
 
@@ -443,6 +1221,47 @@ static struct track_info *ip_get_ti(const char *filename)
 	return ti;
 }
 
+struct track_info *cache_read_ti(const char *filename)
+{
+	return ip_get_ti(filename);
+}
+
+/* cached entries without duration are read again unless it is a stream */
+static int needs_reload(struct track_info *ti)
+{
+	return !skip_track_info && ti->duration == 0 && !is_http_url(ti->filename);
+}
+
+int cache_needs_read(const char *filename)
+{
+	struct track_info *ti;
+
+	if (skip_track_info || pl_env_var(filename, NULL))
+		return 0;
+	ti = lookup_cache_entry(filename, hash_str(filename));
+	return !ti || needs_reload(ti);
+}
+
+struct track_info *cache_add_ti(struct track_info *ti)
+{
+	unsigned int hash = hash_str(ti->filename);
+	struct track_info *old;
+
+	old = lookup_cache_entry(ti->filename, hash);
+	if (old && !needs_reload(old)) {
+		// added meanwhile
+		track_info_unref(ti);
+		track_info_ref(old);
+		return old;
+	}
+	if (old)
+		do_cache_remove_ti(old, hash);
+	add_ti(ti, hash);
+	journal_add_ti(ti);
+	track_info_ref(ti);
+	return ti;
+}
+
 struct track_info *cache_get_ti(const char *filename, int force)
 {
 	unsigned int hash = hash_str(filename);
@@ -463,7 +1282,7 @@ struct track_info *cache_get_ti(const char *filename, int force)
 
 	ti = lookup_cache_entry(filename, hash);
 	if (ti) {
-		if ((!skip_track_info && ti->duration == 0 && !is_http_url(filename)) || force){
+		if (needs_reload(ti) || force) {
 			do_cache_remove_ti(ti, hash);
 			ti = NULL;
 			reload = 1;
@@ -485,6 +1304,7 @@ struct track_info *cache_get_ti(const char *filename, int force)
 		if (!ti)
 			return NULL;
 		add_ti(ti, hash);
+		journal_add_ti(ti);
 	}
 	track_info_ref(ti);
 	return ti;
@@ -492,13 +1312,25 @@ struct track_info *cache_get_ti(const char *filename, int force)
 
 struct track_info **cache_refresh(int *count, int force)
 {
-	struct track_info **tis = get_track_infos(true);
-	int i, n = total;
+	struct stat_sweep_entry *st;
+	struct track_info **tis;
+	int i, n;
+
+	materialize_all();
+	n = hashtable_count(&hash_table);
+	tis = get_track_infos(true);
+
+	// the tis are referenced, nobody needs the lock while we wait for stat()
+	st = xnew(struct stat_sweep_entry, n);
+	for (i = 0; i < n; i++)
+		st[i].filename = tis[i]->filename;
+	cache_unlock();
+	stat_sweep(st, n);
+	cache_lock();
 
 	for (i = 0; i < n; i++) {
 		unsigned int hash;
 		struct track_info *ti = tis[i];
-		struct stat st;
 		int rc = 0;
 
 		cache_yield();
@@ -513,8 +1345,8 @@ struct track_info **cache_refresh(int *count, int force)
 		 */
 
 		if (!is_url(ti->filename)) {
-			rc = stat(ti->filename, &st);
-			if (!rc && !force && ti->mtime == st.st_mtime) {
+			rc = st[i].err;
+			if (!rc && !force && ti->mtime == st[i].mtime) {
 				// unchanged
 				track_info_unref(ti);
 				tis[i] = NULL;
@@ -539,6 +1371,7 @@ struct track_info **cache_refresh(int *count, int force)
 			new_ti = ip_get_ti(ti->filename);
 			if (new_ti) {
 				add_ti(new_ti, hash);
+				journal_add_ti(new_ti);
 
 				if (track_info_unique_ref(ti)) {
 					track_info_unref(ti);
@@ -560,6 +1393,7 @@ struct track_info **cache_refresh(int *count, int force)
 			ti->next = NULL;
 		}
 	}
+	free(st);
 	*count = n;
 	return tis;
 }
@@ -31,7 +31,25 @@ extern struct fifo_mutex cache_mutex;
 int cache_init(void);
 int cache_close(void);
 struct track_info *cache_get_ti(const char *filename, int force);
+
+/*
+ * For reading tags without holding the cache lock:
+ *
+ * cache_needs_read() returns 1 if cache_get_ti() would have to read the
+ * tags of @filename. cache_read_ti() reads them and can be called
+ * without the lock. cache_add_ti() adds the result to the cache unless
+ * the file was added meanwhile and returns the cached track_info with a
+ * reference. The reference to @ti is consumed.
+ */
+int cache_needs_read(const char *filename);
+struct track_info *cache_read_ti(const char *filename);
+struct track_info *cache_add_ti(struct track_info *ti);
 void cache_remove_ti(struct track_info *ti);
+/*
+ * records the play count of @ti, which is copied to the cached track_info
+ * of the same file if @ti has been replaced meanwhile
+ */
+void cache_update_ti(struct track_info *ti);
 struct track_info **cache_refresh(int *count, int force);
 struct track_info *lookup_cache_entry(const char *filename, unsigned int hash);
 
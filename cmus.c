@@ -39,6 +39,8 @@
 #include "discid.h"
 #include "locking.h"
 #include "pl_env.h"
+#include "intern.h"
+#include "profile.h"
 
 #include <sys/types.h>
 #include <sys/stat.h>
@@ -71,8 +73,12 @@ static int (*x11_close)(void *) = NULL;
 
 int cmus_init(void)
 {
+	uint64_t t;
+
 	playable_exts = ip_get_supported_extensions();
+	t = profile_get();
 	cache_init();
+	profile_phase("cache_init", t);
 	job_init();
 	play_queue_init();
 	return 0;
@@ -80,9 +86,20 @@ int cmus_init(void)
 
 void cmus_exit(void)
 {
+	struct intern_stats stats;
+	uint64_t t;
+
+	t = profile_get();
 	job_exit();
+	profile_phase("job_exit", t);
+	t = profile_get();
 	if (cache_close())
 		d_print("error: %s\n", strerror(errno));
+	profile_phase("cache_close", t);
+
+	intern_get_stats(&stats);
+	d_print("interned strings: %zu, references: %zu, bytes: %zu, saved: %zu\n",
+			stats.strings, stats.refs, stats.bytes, stats.saved);
 }
 
 void cmus_next(void)
@@ -69,6 +69,7 @@ void view_clear(int view)
 	case TREE_VIEW:
 	case SORTED_VIEW:
 		worker_remove_jobs_by_type(JOB_TYPE_LIB);
+		lib_autosave_cancel();
 		editable_clear(&lib_editable);
 
 		/* FIXME: make this optional? */
@@ -154,6 +155,7 @@ void view_load(int view, char *arg)
 	case TREE_VIEW:
 	case SORTED_VIEW:
 		worker_remove_jobs_by_type(JOB_TYPE_LIB);
+		lib_autosave_cancel();
 		editable_clear(&lib_editable);
 		cmus_add(lib_add_track, name, FILE_TYPE_PL, JOB_TYPE_LIB, 0,
 				NULL);
@@ -562,7 +564,14 @@ static void cmd_live_filter(char *arg)
 
 static void cmd_filter(char *arg)
 {
-	filters_set_anonymous(arg);
+	int f = parse_one_flag((const char **)&arg, "e");
+
+	if (f == -1)
+		return;
+	if (f == 'e')
+		filters_explain(arg);
+	else
+		filters_set_anonymous(arg);
 }
 
 static void cmd_fset(char *arg)
@@ -1801,6 +1810,39 @@ static void cmd_win_down(char *arg)
 	window_down(current_win(), num_rows);
 }
 
+static void cmd_win_goto(char *arg)
+{
+	struct window *win = current_win();
+	int count = window_get_count(win);
+	int num;
+	char *end;
+
+	if (!arg) {
+		info_msg("row %d of %d", window_get_sel_index(win) + 1, count);
+		return;
+	}
+
+	num = get_number(arg, &end);
+	if (end == arg || (*end && strcmp(end, "%"))) {
+		error_msg("invalid argument\n");
+		return;
+	}
+	if (*end) {
+		if (num > 100) {
+			error_msg("invalid argument\n");
+			return;
+		}
+		/* 0% is the first row, 100% the last */
+		window_goto_index(win, count > 1 ? (int)((long long)(count - 1) * num / 100) : 0);
+	} else {
+		if (num == 0) {
+			error_msg("invalid argument\n");
+			return;
+		}
+		window_goto_index(win, num - 1);
+	}
+}
+
 static void cmd_win_next(char *arg)
 {
 	if (cur_view == TREE_VIEW)
@@ -2690,6 +2732,7 @@ struct command commands[] = {
 	{ "win-add-q",             cmd_win_add_q,        0, 1,  NULL,                 0, 0          },
 	{ "win-bottom",            cmd_win_bottom,       0, 0,  NULL,                 0, 0          },
 	{ "win-down",              cmd_win_down,         0, 1,  NULL,                 0, 0          },
+	{ "win-goto",              cmd_win_goto,         0, 1,  NULL,                 0, 0          },
 	{ "win-half-page-down",    cmd_win_hf_pg_down,   0, 0,  NULL,                 0, 0          },
 	{ "win-half-page-up",      cmd_win_hf_pg_up,     0, 0,  NULL,                 0, 0          },
 	{ "win-mv-after",          cmd_win_mv_after,     0, 0,  NULL,                 0, 0          },
@@ -0,0 +1,6 @@
+#ifndef CONFIG_CDIO_H
+#define CONFIG_CDIO_H
+
+/* #define HAVE_CDDB */
+
+#endif
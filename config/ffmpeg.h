@@ -0,0 +1,7 @@
+#ifndef CONFIG_FFMPEG_H
+#define CONFIG_FFMPEG_H
+
+#define HAVE_FFMPEG_AVCODEC_H ""
+/* #define USE_FALLBACK_IP */
+
+#endif
@@ -0,0 +1,6 @@
+#ifndef CONFIG_MODPLUG_H
+#define CONFIG_MODPLUG_H
+
+#define MODPLUG_API_8 ""
+
+#endif
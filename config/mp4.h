@@ -0,0 +1,6 @@
+#ifndef CONFIG_MP4_H
+#define CONFIG_MP4_H
+
+#define USE_MPEG4IP ""
+
+#endif
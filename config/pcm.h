@@ -0,0 +1,6 @@
+#ifndef CONFIG_PCM_H
+#define CONFIG_PCM_H
+
+#define HAVE_TARGET_CLONES 1
+
+#endif
@@ -0,0 +1,6 @@
+#ifndef CONFIG_SAMPLERATE_H
+#define CONFIG_SAMPLERATE_H
+
+/* #define HAVE_SAMPLERATE */
+
+#endif
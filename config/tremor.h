@@ -0,0 +1,6 @@
+#ifndef CONFIG_TREMOR_H
+#define CONFIG_TREMOR_H
+
+/* #define CONFIG_TREMOR */
+
+#endif
@@ -0,0 +1,6 @@
+#ifndef CONFIG_WATCH_H
+#define CONFIG_WATCH_H
+
+#define HAVE_INOTIFY 1
+
+#endif
@@ -0,0 +1,6 @@
+#ifndef CONFIG_WCWIDTH_H
+#define CONFIG_WCWIDTH_H
+
+#define HAVE_WCWIDTH 1
+
+#endif
@@ -0,0 +1,46 @@
+/*
+ * Copyright 2026 Various Authors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CMUS_CONTRIB_BENCH_H
+#define CMUS_CONTRIB_BENCH_H
+
+/* helpers shared by the stress tests and benchmarks in contrib/ */
+
+#include <stdint.h>
+#include <time.h>
+
+#define BENCH_RND_SEED 0x9e3779b97f4a7c15ULL
+
+/* xorshift64, the same sequence on every run */
+static inline uint32_t bench_rnd(uint64_t *state)
+{
+	*state ^= *state << 13;
+	*state ^= *state >> 7;
+	*state ^= *state << 17;
+	return *state >> 32;
+}
+
+/* monotonic time in seconds */
+static inline double bench_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+#endif
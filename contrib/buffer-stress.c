@@ -0,0 +1,184 @@
+/*
+ * Copyright 2026 Various Authors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Stress test for the lock-free chunk buffer (buffer.c)
+ *
+ * A producer thread writes a stream of sequence-numbered records through
+ * the real buffer while the main thread consumes it, in randomly sized
+ * pieces and with random early hand-offs of partially filled chunks. The
+ * consumer checks that every record arrives once, in order and intact.
+ *
+ * Each record is a 4 byte sequence number, a 2 byte payload length and
+ * the payload, which is derived from the sequence number. Records are
+ * split across chunks freely.
+ *
+ * Usage: buffer-stress [MEGABYTES [CHUNKS]]
+ *
+ * Build with "make check-buffer", or "make check-buffer-tsan" to run it
+ * under ThreadSanitizer.
+ */
+
+#include "../buffer.h"
+#include "../prog.h"
+#include "bench.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define HEADER_SIZE 6
+#define MAX_PAYLOAD 4000
+
+struct record_stream {
+	uint32_t seq;
+	/* position within the current record */
+	unsigned int pos;
+	unsigned int len;
+};
+
+static unsigned long long total_bytes;
+
+static unsigned int payload_len(uint32_t seq)
+{
+	return 1 + (seq * 2654435761U >> 7) % MAX_PAYLOAD;
+}
+
+static unsigned char record_byte(const struct record_stream *s)
+{
+	unsigned int i = s->pos;
+
+	if (i < 4)
+		return s->seq >> (i * 8);
+	if (i < HEADER_SIZE)
+		return s->len >> ((i - 4) * 8);
+	return s->seq * 131 + (i - HEADER_SIZE) * 7;
+}
+
+static void stream_init(struct record_stream *s)
+{
+	s->seq = 0;
+	s->pos = 0;
+	s->len = payload_len(0);
+}
+
+static void stream_next(struct record_stream *s)
+{
+	if (++s->pos == HEADER_SIZE + s->len) {
+		s->seq++;
+		s->pos = 0;
+		s->len = payload_len(s->seq);
+	}
+}
+
+static void *producer(void *arg)
+{
+	struct record_stream s;
+	unsigned long long n = 0;
+	uint64_t state = BENCH_RND_SEED;
+
+	stream_init(&s);
+	while (n < total_bytes) {
+		char *pos;
+		int size, count, i;
+
+		size = buffer_get_wpos(&pos);
+		if (size == 0) {
+			sched_yield();
+			continue;
+		}
+		if (size < 1024)
+			die("buffer_get_wpos returned %d bytes\n", size);
+
+		count = 1 + bench_rnd(&state) % size;
+		if (count > total_bytes - n)
+			count = total_bytes - n;
+		for (i = 0; i < count; i++) {
+			pos[i] = record_byte(&s);
+			stream_next(&s);
+		}
+		n += count;
+
+		/* hand partially filled chunks over now and then */
+		if (!buffer_fill(count) && bench_rnd(&state) % 8 == 0)
+			buffer_fill(0);
+	}
+	buffer_fill(0);
+	return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+	struct record_stream s;
+	unsigned long long n = 0;
+	uint64_t state = 0x2545f4914f6cdd1dULL;
+	unsigned long chunks_consumed = 0;
+	pthread_t thread;
+	int nr_chunks;
+
+	program_name = argv[0];
+	total_bytes = (argc > 1 ? strtoull(argv[1], NULL, 10) : 64) << 20;
+	nr_chunks = argc > 2 ? atoi(argv[2]) : 5;
+	if (nr_chunks < 1)
+		die("invalid number of chunks\n");
+	buffer_nr_chunks = nr_chunks;
+
+	buffer_init();
+	if (pthread_create(&thread, NULL, producer, NULL))
+		die_errno("pthread_create");
+
+	stream_init(&s);
+	while (n < total_bytes) {
+		char *pos;
+		int size, count, i;
+
+		size = buffer_get_rpos(&pos);
+		if (size == 0) {
+			sched_yield();
+			continue;
+		}
+		if (size > CHUNK_SIZE)
+			die("buffer_get_rpos returned %d bytes\n", size);
+		if (buffer_get_filled_chunks() > buffer_nr_chunks)
+			die("%d chunks filled\n", buffer_get_filled_chunks());
+
+		count = 1 + bench_rnd(&state) % size;
+		for (i = 0; i < count; i++) {
+			unsigned char c = pos[i];
+
+			if (c != record_byte(&s)) {
+				die("record %u byte %u: expected 0x%02x, got 0x%02x "
+						"(stream offset %llu)\n", s.seq, s.pos,
+						record_byte(&s), c, n + i);
+			}
+			stream_next(&s);
+		}
+		n += count;
+		chunks_consumed += buffer_consume(count);
+	}
+	pthread_join(thread, NULL);
+
+	if (buffer_get_filled_chunks())
+		die("%d chunks left after the end of the stream\n", buffer_get_filled_chunks());
+
+	printf("%llu bytes, %u records, %lu chunks through %u chunk buffer: OK\n",
+			n, s.seq, chunks_consumed, buffer_nr_chunks);
+	buffer_free();
+	return 0;
+}
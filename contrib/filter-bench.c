@@ -0,0 +1,378 @@
+/*
+ * Copyright 2026 Various Authors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Test and benchmark for the compiled filter evaluator (expr.c)
+ *
+ * A generated library is filtered with each of a set of filters by the
+ * tree walking evaluator expr_eval() used before filters were compiled,
+ * by expr_eval() and by expr_eval_many(). All three must match the same
+ * tracks. The time per track of each is printed.
+ *
+ * Usage: filter-bench [TRACKS [FILTER]...]
+ *
+ * Build and run with "make check-filter".
+ */
+
+#include "../expr.h"
+#include "../comment.h"
+#include "../convert.h"
+#include "../glob.h"
+#include "../keyval.h"
+#include "../options.h"
+#include "../prog.h"
+#include "../ui_curses.h"
+#include "../utils.h"
+#include "../xmalloc.h"
+#include "bench.h"
+
+#include <limits.h>
+#include <locale.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* normally defined by ui_curses.c and options.c */
+char *charset = (char *)"UTF-8";
+int using_utf8 = 1;
+char *clipped_text_internal = (char *)"...";
+int intern_tags = 1;
+
+void error_msg(const char *format, ...)
+{
+	va_list ap;
+
+	va_start(ap, format);
+	vfprintf(stderr, format, ap);
+	va_end(ap);
+	fputc('\n', stderr);
+}
+
+static const char * const default_filters[] = {
+	"~a1",
+	"~n1-3",
+	"filename=\"*artist1*\"",
+	"album!=\"*0*\"",
+	"~l album ~t title ~y1990-2000",
+	"~g jazz | ~g rock",
+	"!~a école ~d>200",
+	"title=\"*über*\"",
+	"date>=1990&date<2000&(genre=\"*rock*\"|genre=\"*metal*\")",
+	"~s | !~T",
+	NULL
+};
+
+/* the evaluator before expr_compile() {{{ */
+
+static const char *str_val(const char *key, struct track_info *ti, char **need_free)
+{
+	const char *val;
+	*need_free = NULL;
+	if (strcmp(key, "filename") == 0) {
+		val = ti->filename;
+		if (!using_utf8 && utf8_encode(val, charset, need_free) == 0) {
+			val = *need_free;
+		}
+	} else if (strcmp(key, "codec") == 0) {
+		val = ti->codec;
+	} else if (strcmp(key, "codec_profile") == 0) {
+		val = ti->codec_profile;
+	} else {
+		val = keyvals_get_val(ti->comments, key);
+	}
+	return val;
+}
+
+static int int_val(const char *key, struct track_info *ti)
+{
+	int val;
+	if (strcmp(key, "duration") == 0) {
+		val = ti->duration;
+		/* duration of a stream is infinite (well, almost) */
+		if (is_http_url(ti->filename))
+			val = INT_MAX;
+	} else if (strcmp(key, "date") == 0) {
+		val = (ti->date >= 0) ? (ti->date / 10000) : -1;
+	} else if (strcmp(key, "originaldate") == 0) {
+		val = (ti->originaldate >= 0) ? (ti->originaldate / 10000) : -1;
+	} else if (strcmp(key, "bitrate") == 0) {
+		val = (ti->bitrate >= 0) ? (int) (ti->bitrate / 1000. + 0.5) : -1;
+	} else if (strcmp(key, "play_count") == 0) {
+		val = ti->play_count;
+	} else if (strcmp(key, "bpm") == 0) {
+		val = ti->bpm;
+	} else {
+		val = comments_get_int(ti->comments, key);
+	}
+	return val;
+}
+
+static int old_expr_eval(struct expr *expr, struct track_info *ti)
+{
+	enum expr_type type = expr->type;
+	const char *key;
+
+	if (expr->left) {
+		int left = old_expr_eval(expr->left, ti);
+
+		if (type == EXPR_AND)
+			return left && old_expr_eval(expr->right, ti);
+		if (type == EXPR_OR)
+			return left || old_expr_eval(expr->right, ti);
+		/* EXPR_NOT */
+		return !left;
+	}
+
+	key = expr->key;
+	if (type == EXPR_STR) {
+		int res;
+		char *need_free;
+		const char *val = str_val(key, ti, &need_free);
+		if (!val)
+			val = "";
+		res = glob_match(&expr->estr.glob_head, val);
+		free(need_free);
+		if (expr->estr.op == SOP_EQ)
+			return res;
+		return !res;
+	} else if (type == EXPR_INT) {
+		int val = int_val(key, ti);
+		int res;
+		if (expr->eint.val == -1) {
+			/* -1 is "not set"
+			 * doesn't make sense to do 123 < "not set"
+			 * but it makes sense to do date=-1 (date is not set)
+			 */
+			if (expr->eint.op == IOP_EQ)
+				return val == -1;
+			if (expr->eint.op == IOP_NE)
+				return val != -1;
+		}
+		if (val == -1) {
+			/* tag not set, can't compare */
+			return 0;
+		}
+		res = val - expr->eint.val;
+		return expr_op_to_bool(res, expr->eint.op);
+	} else if (type == EXPR_ID) {
+		int a = 0, b = 0;
+		const char *sa, *sb;
+		char *fa, *fb;
+		int res = 0;
+		if ((sa = str_val(key, ti, &fa))) {
+			if ((sb = str_val(expr->eid.key, ti, &fb))) {
+				res = strcmp(sa, sb);
+				free(fa);
+				free(fb);
+				return expr_op_to_bool(res, expr->eid.op);
+			}
+			free(fa);
+		} else {
+			a = int_val(key, ti);
+			b = int_val(expr->eid.key, ti);
+			res = a - b;
+			if (a == -1 || b == -1) {
+				switch (expr->eid.op) {
+				case KOP_EQ:
+					return res == 0;
+				case KOP_NE:
+					return res != 0;
+				default:
+					return 0;
+				}
+			}
+			return expr_op_to_bool(res, expr->eid.op);
+		}
+		return res;
+	}
+	if (strcmp(key, "stream") == 0)
+		return is_http_url(ti->filename);
+	return track_info_has_tag(ti);
+}
+
+/* }}} */
+
+static uint64_t rnd_state = BENCH_RND_SEED;
+
+static char *xprintf(const char *format, ...)
+{
+	char buf[256];
+	va_list ap;
+
+	va_start(ap, format);
+	vsnprintf(buf, sizeof(buf), format, ap);
+	va_end(ap);
+	return xstrdup(buf);
+}
+
+static struct track_info *make_track(int i)
+{
+	static const char * const genres[] = {
+		"Rock", "Jazz", "Classical", "Electronic", "Hip-Hop", "Folk", "Pop", "Metal",
+	};
+	static const char * const words[] = {
+		"Night", "Love", "Blue", "École", "Straße", "Fire", "Rain", "Über", "Road", "Title",
+	};
+	struct track_info *ti;
+	struct keyval *kv;
+	char filename[256];
+	int artist = i / 120, album = i / 12, n = 0;
+
+	if (i % 97 == 0) {
+		snprintf(filename, sizeof(filename), "http://radio.example.org/stream%d", i);
+		ti = track_info_new(filename);
+		track_info_set_comments(ti, keyvals_new(0));
+		return ti;
+	}
+
+	snprintf(filename, sizeof(filename), "/home/user/music/artist%d/album%d/%02d.flac",
+			artist, album, i % 12 + 1);
+	ti = track_info_new(filename);
+	ti->duration = 60 + bench_rnd(&rnd_state) % 400;
+	if (i % 53 == 0) {
+		track_info_set_comments(ti, keyvals_new(0));
+		return ti;
+	}
+
+	kv = keyvals_new(8);
+	kv[n].key = xstrdup("artist");
+	kv[n++].val = xprintf("%s Artist %d", words[artist % 10], artist);
+	if (album % 5 == 0) {
+		kv[n].key = xstrdup("albumartist");
+		kv[n++].val = xstrdup(album % 10 ? "Various Artists" : kv[0].val);
+	}
+	kv[n].key = xstrdup("album");
+	kv[n++].val = xprintf("%s Album %d", words[album % 7], album);
+	kv[n].key = xstrdup("title");
+	kv[n++].val = xprintf("%s %s %d", words[bench_rnd(&rnd_state) % 10], words[bench_rnd(&rnd_state) % 10], i);
+	kv[n].key = xstrdup("tracknumber");
+	kv[n++].val = xprintf("%d", i % 12 + 1);
+	kv[n].key = xstrdup("discnumber");
+	kv[n++].val = xprintf("%d", 1 + album % 3);
+	kv[n].key = xstrdup("date");
+	kv[n++].val = xprintf("%d", 1960 + album % 60);
+	kv[n].key = xstrdup("genre");
+	kv[n++].val = xstrdup(genres[artist % 8]);
+	track_info_set_comments(ti, kv);
+	return ti;
+}
+
+static const char *no_filter(const char *name)
+{
+	return NULL;
+}
+
+enum { EVAL_TREE, EVAL_COMPILED, EVAL_MANY };
+
+/* ns per track */
+static double bench(int how, struct expr *expr, struct track_info **tis, int nr_tracks,
+		char *match)
+{
+	double start = bench_now(), t;
+	int i, rounds = 0;
+
+	do {
+		switch (how) {
+		case EVAL_TREE:
+			for (i = 0; i < nr_tracks; i++)
+				match[i] = old_expr_eval(expr, tis[i]);
+			break;
+		case EVAL_COMPILED:
+			for (i = 0; i < nr_tracks; i++)
+				match[i] = expr_eval(expr, tis[i]);
+			break;
+		case EVAL_MANY:
+			expr_eval_many(expr, tis, nr_tracks, match);
+			break;
+		}
+		rounds++;
+		t = bench_now() - start;
+	} while (t < 0.2);
+	return t * 1e9 / rounds / nr_tracks;
+}
+
+static void run(const char *filter, struct track_info **tis, int nr_tracks,
+		char *old_match, char *match)
+{
+	struct expr *expr = expr_parse(filter);
+	int i, nr_matches = 0;
+
+	if (!expr)
+		die("%s: %s\n", filter, expr_error());
+	if (expr_check_leaves(&expr, no_filter))
+		die("%s: %s\n", filter, expr_error());
+
+	/* sample pass rates and reorder like lib.c does after a first pass */
+	for (i = 0; i < nr_tracks; i++)
+		expr_eval(expr, tis[i]);
+	expr_compile(expr);
+
+	for (i = 0; i < nr_tracks; i++)
+		old_match[i] = old_expr_eval(expr, tis[i]);
+	for (i = 0; i < nr_tracks; i++) {
+		match[i] = expr_eval(expr, tis[i]);
+		if (match[i] != old_match[i])
+			die("%s: expr_eval() differs on %s\n", filter, tis[i]->filename);
+		nr_matches += match[i];
+	}
+	memset(match, 2, nr_tracks);
+	expr_eval_many(expr, tis, nr_tracks, match);
+	if (memcmp(match, old_match, nr_tracks))
+		die("%s: expr_eval_many() differs\n", filter);
+
+	printf("%7d %10.1f %10.1f %10.1f  %s\n", nr_matches,
+			bench(EVAL_TREE, expr, tis, nr_tracks, match),
+			bench(EVAL_COMPILED, expr, tis, nr_tracks, match),
+			bench(EVAL_MANY, expr, tis, nr_tracks, match), filter);
+	expr_free(expr);
+}
+
+int main(int argc, char *argv[])
+{
+	const char * const *filters = default_filters;
+	struct track_info **tis;
+	char *old_match, *match;
+	int nr_tracks = 100000, i;
+
+	program_name = argv[0];
+	setlocale(LC_ALL, "");
+	if (argc > 1)
+		nr_tracks = atoi(argv[1]);
+	if (nr_tracks < 1)
+		die("invalid number of tracks\n");
+	if (argc > 2)
+		filters = (const char * const *)argv + 2;
+
+	tis = xnew(struct track_info *, nr_tracks);
+	for (i = 0; i < nr_tracks; i++)
+		tis[i] = make_track(i);
+	old_match = xnew(char, nr_tracks);
+	match = xnew(char, nr_tracks);
+
+	printf("%d tracks, ns per track\n\n", nr_tracks);
+	printf("%7s %10s %10s %10s  %s\n", "matches", "tree", "compiled", "threaded", "filter");
+	for (i = 0; filters[i]; i++)
+		run(filters[i], tis, nr_tracks, old_match, match);
+
+	for (i = 0; i < nr_tracks; i++)
+		track_info_unref(tis[i]);
+	free(tis);
+	free(old_match);
+	free(match);
+	return 0;
+}
@@ -0,0 +1,266 @@
+/*
+ * Copyright 2026 Various Authors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Test and benchmark for the open addressing hash table (hashtable.c)
+ *
+ * First a random mix of inserts, removes and lookups is checked against a
+ * plain array, once with the real hash of the keys and once with a hash
+ * that has only a few hundred values, so that long probe sequences and
+ * growing while the old table is still being moved over are covered.
+ *
+ * Then inserts, lookups of present and missing keys and removes are timed
+ * for 10k entries up to MAX_ENTRIES, with filenames as keys like the track
+ * cache and the library use them. The fixed 1023 bucket chained table the
+ * cache used before is timed next to it, with fewer operations for large
+ * tables since its chains get very long.
+ *
+ * Usage: hashtable-bench [MAX_ENTRIES]
+ *
+ * Build and run with "make check-hashtable".
+ */
+
+#include "../hashtable.h"
+#include "../prog.h"
+#include "../utils.h"
+#include "../xmalloc.h"
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define OLD_HASH_SIZE 1023
+#define NR_LOOKUPS 200000
+
+struct entry {
+	/* for the chained table */
+	struct entry *next;
+	char *filename;
+	uint32_t hash;
+	int present;
+};
+
+static uint64_t rnd_state = BENCH_RND_SEED;
+
+static bool entry_eq(const void *ptr, const void *key)
+{
+	const struct entry *e = ptr;
+
+	return !strcmp(e->filename, key);
+}
+
+static struct entry *make_entries(int n, const char *ext)
+{
+	struct entry *entries = xnew0(struct entry, n);
+	int i;
+
+	for (i = 0; i < n; i++) {
+		char buf[256];
+
+		snprintf(buf, sizeof(buf), "/home/user/music/Artist %d/Album %d/%02d - Track %d.%s",
+				i / 120, i / 12, i % 12 + 1, i, ext);
+		entries[i].filename = xstrdup(buf);
+		entries[i].hash = hash_str(buf);
+	}
+	return entries;
+}
+
+static void free_entries(struct entry *entries, int n)
+{
+	int i;
+
+	for (i = 0; i < n; i++)
+		free(entries[i].filename);
+	free(entries);
+}
+
+/* the table cache.c used before hashtable.c {{{ */
+
+static struct entry *old_table[OLD_HASH_SIZE];
+
+static void old_insert(struct entry *e)
+{
+	unsigned int pos = e->hash % OLD_HASH_SIZE;
+
+	e->next = old_table[pos];
+	old_table[pos] = e;
+}
+
+static struct entry *old_find(const char *filename, uint32_t hash)
+{
+	struct entry *e = old_table[hash % OLD_HASH_SIZE];
+
+	while (e) {
+		if (!strcmp(filename, e->filename))
+			return e;
+		e = e->next;
+	}
+	return NULL;
+}
+
+static void old_remove(struct entry *e)
+{
+	struct entry **p = &old_table[e->hash % OLD_HASH_SIZE];
+
+	while (*p != e)
+		p = &(*p)->next;
+	*p = e->next;
+}
+
+/* }}} */
+
+static void check(int n, uint32_t hash_mask, int iterations)
+{
+	struct hashtable h = HASHTABLE_INIT;
+	struct entry *entries = make_entries(n, "ogg");
+	uint32_t count = 0;
+	int it, i;
+
+	for (i = 0; i < n; i++)
+		entries[i].hash &= hash_mask;
+
+	for (it = 0; it < iterations; it++) {
+		struct entry *e = &entries[bench_rnd(&rnd_state) % n];
+		uint32_t r = bench_rnd(&rnd_state) % 8;
+
+		if (r < 4 && !e->present) {
+			hashtable_insert(&h, e->hash, e);
+			e->present = 1;
+			count++;
+		} else if (r < 7 && e->present) {
+			if (!hashtable_remove(&h, e->hash, e))
+				die("%s not removed\n", e->filename);
+			e->present = 0;
+			count--;
+		} else if (hashtable_find(&h, e->hash, entry_eq, e->filename) != (e->present ? e : NULL)) {
+			die("lookup of %s failed\n", e->filename);
+		}
+
+		if (it % (iterations / 16) == 0 || it == iterations - 1) {
+			struct hashtable_iter iter;
+			uint32_t found = 0;
+
+			hashtable_iter_init(&iter, &h);
+			while ((e = hashtable_iter_next(&iter))) {
+				if (!e->present)
+					die("%s iterated after removal\n", e->filename);
+				found++;
+			}
+			if (found != count || hashtable_count(&h) != count)
+				die("%u entries iterated, count %u, expected %u\n",
+						found, hashtable_count(&h), count);
+		}
+	}
+
+	hashtable_clear(&h);
+	if (hashtable_count(&h))
+		die("entries left after hashtable_clear()\n");
+	free_entries(entries, n);
+}
+
+static void bench(int n)
+{
+	struct hashtable h = HASHTABLE_INIT;
+	struct entry *entries = make_entries(n, "flac");
+	struct entry *missing = make_entries(NR_LOOKUPS, "mp3");
+	int *order = xnew(int, NR_LOOKUPS);
+	/* the chained table gets slow, spend about as much time on it */
+	int old_ops = n <= 10000 ? NR_LOOKUPS : NR_LOOKUPS / (n / 10000);
+	int old_removes = old_ops < n ? old_ops : n;
+	double t, new_ns[4], old_ns[4];
+	long found = 0;
+	int i;
+
+	for (i = 0; i < NR_LOOKUPS; i++)
+		order[i] = bench_rnd(&rnd_state) % n;
+
+	t = bench_now();
+	for (i = 0; i < n; i++)
+		hashtable_insert(&h, entries[i].hash, &entries[i]);
+	new_ns[0] = (bench_now() - t) * 1e9 / n;
+	t = bench_now();
+	for (i = 0; i < NR_LOOKUPS; i++) {
+		struct entry *e = &entries[order[i]];
+
+		found += hashtable_find(&h, e->hash, entry_eq, e->filename) == e;
+	}
+	new_ns[1] = (bench_now() - t) * 1e9 / NR_LOOKUPS;
+	t = bench_now();
+	for (i = 0; i < NR_LOOKUPS; i++)
+		found -= !!hashtable_find(&h, missing[i].hash, entry_eq, missing[i].filename);
+	new_ns[2] = (bench_now() - t) * 1e9 / NR_LOOKUPS;
+	t = bench_now();
+	for (i = 0; i < n; i++)
+		hashtable_remove(&h, entries[i].hash, &entries[i]);
+	new_ns[3] = (bench_now() - t) * 1e9 / n;
+	hashtable_clear(&h);
+
+	t = bench_now();
+	for (i = 0; i < n; i++)
+		old_insert(&entries[i]);
+	old_ns[0] = (bench_now() - t) * 1e9 / n;
+	t = bench_now();
+	for (i = 0; i < old_ops; i++) {
+		struct entry *e = &entries[order[i]];
+
+		found += old_find(e->filename, e->hash) == e;
+	}
+	old_ns[1] = (bench_now() - t) * 1e9 / old_ops;
+	t = bench_now();
+	for (i = 0; i < old_ops; i++)
+		found -= !!old_find(missing[i].filename, missing[i].hash);
+	old_ns[2] = (bench_now() - t) * 1e9 / old_ops;
+	t = bench_now();
+	for (i = 0; i < old_removes; i++)
+		old_remove(&entries[i]);
+	old_ns[3] = (bench_now() - t) * 1e9 / old_removes;
+	memset(old_table, 0, sizeof(old_table));
+
+	if (found != NR_LOOKUPS + old_ops)
+		die("%ld of %d lookups succeeded\n", found, NR_LOOKUPS + old_ops);
+
+	for (i = 0; i < 4; i++) {
+		static const char * const ops[] = { "insert", "find", "find missing", "remove" };
+
+		printf("%8d %-13s %10.1f %10.1f\n", n, ops[i], new_ns[i], old_ns[i]);
+	}
+
+	free(order);
+	free_entries(missing, NR_LOOKUPS);
+	free_entries(entries, n);
+}
+
+int main(int argc, char *argv[])
+{
+	int max = 1000000, n;
+
+	program_name = argv[0];
+	if (argc > 1)
+		max = atoi(argv[1]);
+	if (max < 10000)
+		die("MAX_ENTRIES must be at least 10000\n");
+
+	check(100000, ~0U, 2000000);
+	check(5000, 0x1ff, 500000);
+	printf("hashtable: random inserts, removes and lookups: OK\n\n");
+
+	printf("%8s %-13s %10s %10s\n", "entries", "ns per", "hashtable", "chained");
+	for (n = 10000; n <= max; n *= 10)
+		bench(n);
+	return 0;
+}
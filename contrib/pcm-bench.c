@@ -0,0 +1,451 @@
+/*
+ * Copyright 2026 Various Authors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Test and benchmark for the soft volume kernels (pcm_scale_*() in pcm.c)
+ *
+ * The kernels are compared byte for byte with the per-sample code that
+ * player.c used before them. Stereo is checked for every volume from 0 to
+ * PCM_VOL_SCALE and for replaygain volumes above it, which need clamping,
+ * with and without byte swapping, and for every buffer length up to
+ * MAX_TAIL frames so that each partial block is covered. 1 to 8 channels
+ * are checked the same way with mixed volumes, against the old code
+ * applied to one sample at a time. Bytes after the end of the buffer must
+ * not change. Then the throughput of the kernels is printed next to that
+ * of the old code (applied one sample at a time for other than 2
+ * channels).
+ *
+ * "make check-pcm" runs it linked with pcm.o, which uses the AVX2 clones
+ * on CPUs that have AVX2, and built with -DPCM_VOL_CLONES= so that only
+ * the default code is used.
+ */
+
+#include "../pcm.h"
+#include "../prog.h"
+#include "../config/pcm.h"
+#include "bench.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_CHANNELS 8
+#define MAX_TAIL 64
+#define LONG_FRAMES 4099
+#define GUARD 64
+#define BENCH_SIZE (64 * 1024)
+
+/* the code removed from player.c {{{ */
+
+#define SOFT_VOL_SCALE PCM_VOL_SCALE
+
+static inline uint16_t swap_uint16(uint16_t x)
+{
+	return (x >> 8) | (x << 8);
+}
+
+static inline uint32_t swap_uint32(uint32_t x)
+{
+	return (x >> 24) | ((x >> 8) & 0xff00) | ((x << 8) & 0xff0000) | (x << 24);
+}
+
+static inline void scale_sample_int16_t(int16_t *buf, int i, int vol, int swap)
+{
+	int32_t sample = swap ? (int16_t)swap_uint16(buf[i]) : buf[i];
+
+	/* widened to 64 bits, the original overflowed above SOFT_VOL_SCALE */
+	if (sample < 0) {
+		sample = ((int64_t)sample * vol - SOFT_VOL_SCALE / 2) / SOFT_VOL_SCALE;
+		if (sample < INT16_MIN)
+			sample = INT16_MIN;
+	} else {
+		sample = ((int64_t)sample * vol + SOFT_VOL_SCALE / 2) / SOFT_VOL_SCALE;
+		if (sample > INT16_MAX)
+			sample = INT16_MAX;
+	}
+	buf[i] = swap ? swap_uint16(sample) : sample;
+}
+
+static inline int32_t scale_sample_s24le(int32_t s, int vol)
+{
+	int64_t sample = s;
+
+	if (sample < 0) {
+		sample = (sample * vol - SOFT_VOL_SCALE / 2) / SOFT_VOL_SCALE;
+		if (sample < -0x800000)
+			sample = -0x800000;
+	} else {
+		sample = (sample * vol + SOFT_VOL_SCALE / 2) / SOFT_VOL_SCALE;
+		if (sample > 0x7fffff)
+			sample = 0x7fffff;
+	}
+	return sample;
+}
+
+static inline void scale_sample_int32_t(int32_t *buf, int i, int vol, int swap)
+{
+	int64_t sample = swap ? (int32_t)swap_uint32(buf[i]) : buf[i];
+
+	if (sample < 0) {
+		sample = (sample * vol - SOFT_VOL_SCALE / 2) / SOFT_VOL_SCALE;
+		if (sample < INT32_MIN)
+			sample = INT32_MIN;
+	} else {
+		sample = (sample * vol + SOFT_VOL_SCALE / 2) / SOFT_VOL_SCALE;
+		if (sample > INT32_MAX)
+			sample = INT32_MAX;
+	}
+	buf[i] = swap ? swap_uint32(sample) : sample;
+}
+
+#define SCALE_SAMPLES(TYPE, buffer, count, l, r, swap)				\
+{										\
+	const int frames = count / sizeof(TYPE) / 2;				\
+	TYPE *buf = (void *) buffer;						\
+	int i;									\
+										\
+	if (l != SOFT_VOL_SCALE && r != SOFT_VOL_SCALE) {			\
+		for (i = 0; i < frames; i++) {					\
+			scale_sample_##TYPE(buf, i * 2, l, swap);		\
+			scale_sample_##TYPE(buf, i * 2 + 1, r, swap);		\
+		}								\
+	} else if (l != SOFT_VOL_SCALE) {					\
+		for (i = 0; i < frames; i++)					\
+			scale_sample_##TYPE(buf, i * 2, l, swap);		\
+	} else if (r != SOFT_VOL_SCALE) {					\
+		for (i = 0; i < frames; i++)					\
+			scale_sample_##TYPE(buf, i * 2 + 1, r, swap);		\
+	}									\
+}
+
+static inline int32_t read_s24le(const char *buf)
+{
+	const unsigned char *b = (const unsigned char *) buf;
+	return b[0] | (b[1] << 8) | (((const signed char *) buf)[2] << 16);
+}
+
+static inline void write_s24le(char *buf, int32_t x)
+{
+	unsigned char *b = (unsigned char *) buf;
+	b[0] = x;
+	b[1] = x >> 8;
+	b[2] = x >> 16;
+}
+
+static void scale_samples_s24le(char *buf, unsigned int count, int l, int r)
+{
+	int frames = count / 3 / 2;
+	if (l != SOFT_VOL_SCALE && r != SOFT_VOL_SCALE) {
+		while (frames--) {
+			write_s24le(buf, scale_sample_s24le(read_s24le(buf), l));
+			buf += 3;
+			write_s24le(buf, scale_sample_s24le(read_s24le(buf), r));
+			buf += 3;
+		}
+	} else if (l != SOFT_VOL_SCALE) {
+		while (frames--) {
+			write_s24le(buf, scale_sample_s24le(read_s24le(buf), l));
+			buf += 3 * 2;
+		}
+	} else if (r != SOFT_VOL_SCALE) {
+		buf += 3;
+		while (frames--) {
+			write_s24le(buf, scale_sample_s24le(read_s24le(buf), r));
+			buf += 3 * 2;
+		}
+	}
+}
+
+/* }}} */
+
+enum { FMT_S16, FMT_S24LE, FMT_S32, NR_FORMATS };
+
+static const struct {
+	const char *name;
+	int size;
+	int can_swap;
+} formats[NR_FORMATS] = {
+	{ "s16",   2, 1 },
+	{ "s24le", 3, 0 },
+	{ "s32",   4, 1 },
+};
+
+static uint64_t rnd_state = BENCH_RND_SEED;
+static unsigned long nr_checks;
+
+/* the stereo code from player.c */
+static void old_scale(int fmt, char *buffer, int nr_frames, int l, int r, int swap)
+{
+	unsigned int count = nr_frames * 2 * formats[fmt].size;
+
+	switch (fmt) {
+	case FMT_S16:
+		SCALE_SAMPLES(int16_t, buffer, count, l, r, swap);
+		break;
+	case FMT_S24LE:
+		scale_samples_s24le(buffer, count, l, r);
+		break;
+	case FMT_S32:
+		SCALE_SAMPLES(int32_t, buffer, count, l, r, swap);
+		break;
+	}
+}
+
+/* the same for any number of channels, one sample at a time */
+static void ref_scale(int fmt, char *buf, int frames, int channels, const int *vol, int swap)
+{
+	int i, count = frames * channels;
+
+	if (channels == 2) {
+		old_scale(fmt, buf, frames, vol[0], vol[1], swap);
+		return;
+	}
+
+	for (i = 0; i < count; i++) {
+		int v = vol[i % channels];
+
+		switch (fmt) {
+		case FMT_S16:
+			scale_sample_int16_t((int16_t *)buf, i, v, swap);
+			break;
+		case FMT_S24LE:
+			write_s24le(buf + i * 3, scale_sample_s24le(read_s24le(buf + i * 3), v));
+			break;
+		case FMT_S32:
+			scale_sample_int32_t((int32_t *)buf, i, v, swap);
+			break;
+		}
+	}
+}
+
+static void new_scale(int fmt, char *buf, int frames, int channels, const int *vol, int swap)
+{
+	switch (fmt) {
+	case FMT_S16:
+		pcm_scale_s16(buf, frames, channels, vol, swap);
+		break;
+	case FMT_S24LE:
+		pcm_scale_s24le(buf, frames, channels, vol);
+		break;
+	case FMT_S32:
+		pcm_scale_s32(buf, frames, channels, vol, swap);
+		break;
+	}
+}
+
+/* random samples with the extremes of the format mixed in */
+static void fill(int fmt, char *buf, size_t size)
+{
+	int ss = formats[fmt].size;
+	size_t i;
+
+	for (i = 0; i < size; i++)
+		buf[i] = bench_rnd(&rnd_state);
+	for (i = 0; i + ss <= size; i += ss) {
+		uint32_t r = bench_rnd(&rnd_state);
+
+		if (r % 4)
+			continue;
+		/* 0x7f.. or 0x80.., or with the low byte flipped, in either byte order */
+		memset(buf + i, r & 4 ? 0xff : 0, ss);
+		buf[i + (r & 8 ? 0 : ss - 1)] ^= 0x80;
+		if (r & 16)
+			buf[i + (r & 8 ? ss - 1 : 0)] ^= 1;
+	}
+}
+
+static void check(int fmt, int frames, int channels, const int *vol, int swap)
+{
+	static char orig[LONG_FRAMES * MAX_CHANNELS * 4 + GUARD];
+	static char a[sizeof(orig)], b[sizeof(orig)];
+	size_t size = (size_t)frames * channels * formats[fmt].size;
+	size_t i;
+	int c;
+
+	if (size + GUARD > sizeof(orig))
+		die("buffer too small\n");
+
+	fill(fmt, orig, size + GUARD);
+	memcpy(a, orig, size + GUARD);
+	memcpy(b, orig, size + GUARD);
+	ref_scale(fmt, a, frames, channels, vol, swap);
+	new_scale(fmt, b, frames, channels, vol, swap);
+	nr_checks++;
+	if (!memcmp(a, b, size + GUARD))
+		return;
+
+	for (i = 0; a[i] == b[i]; i++)
+		;
+	fprintf(stderr, "%s, %d frames, %d channels, swap %d, volume", formats[fmt].name,
+			frames, channels, swap);
+	for (c = 0; c < channels; c++)
+		fprintf(stderr, " %#x", vol[c]);
+	fprintf(stderr, "\n");
+	die("byte %zu%s: expected 0x%02x, got 0x%02x (was 0x%02x)\n", i,
+			i >= size ? " after the end" : "", (unsigned char)a[i],
+			(unsigned char)b[i], (unsigned char)orig[i]);
+}
+
+static int random_vol(void)
+{
+	static const int vols[] = {
+		0, 1, 0x110, 0x7fff, 0x8000, 0xfff0, 0xffff,
+		PCM_VOL_SCALE, PCM_VOL_SCALE + 1, 0x10010, 0x18000, 0x3ffff,
+		PCM_VOL_SCALE * 31, 0x7fffffff,
+	};
+	uint32_t r = bench_rnd(&rnd_state);
+
+	if (r & 1)
+		return vols[(r >> 1) % (sizeof(vols) / sizeof(vols[0]))];
+	return (r >> 1) % (PCM_VOL_SCALE * 4);
+}
+
+static void check_stereo(void)
+{
+	static const int others[] = { -1, PCM_VOL_SCALE, 0, 0x8000, 0x18000 };
+	int v, fmt, swap, o;
+
+	/* soft volume only, then replaygain on top of it */
+	for (v = 0; v <= PCM_VOL_SCALE * 16; v += v < PCM_VOL_SCALE ? 1 : 97) {
+		int frames = v % (MAX_TAIL + 1);
+
+		for (o = 0; o < sizeof(others) / sizeof(others[0]); o++) {
+			int other = others[o] < 0 ? v : others[o];
+			int vol[2];
+
+			for (fmt = 0; fmt < NR_FORMATS; fmt++) {
+				for (swap = 0; swap <= formats[fmt].can_swap; swap++) {
+					vol[0] = v;
+					vol[1] = other;
+					check(fmt, frames, 2, vol, swap);
+					vol[0] = other;
+					vol[1] = v;
+					check(fmt, frames, 2, vol, swap);
+				}
+			}
+		}
+	}
+}
+
+static void check_channels(void)
+{
+	int channels, frames, fmt, swap, i, c;
+
+	for (channels = 1; channels <= MAX_CHANNELS; channels++) {
+		for (frames = 0; frames <= MAX_TAIL + 1; frames++) {
+			for (i = 0; i < 16; i++) {
+				int vol[MAX_CHANNELS];
+				int len = frames == MAX_TAIL + 1 ? LONG_FRAMES : frames;
+
+				for (c = 0; c < channels; c++) {
+					switch (i) {
+					case 0:
+						vol[c] = PCM_VOL_SCALE;
+						break;
+					case 1:
+						/* only one channel changes */
+						vol[c] = c ? PCM_VOL_SCALE : 0x8000;
+						break;
+					case 2:
+						vol[c] = c == channels - 1 ? 0x18000 : PCM_VOL_SCALE;
+						break;
+					default:
+						vol[c] = random_vol();
+						break;
+					}
+				}
+				for (fmt = 0; fmt < NR_FORMATS; fmt++) {
+					for (swap = 0; swap <= formats[fmt].can_swap; swap++)
+						check(fmt, len, channels, vol, swap);
+				}
+			}
+		}
+	}
+}
+
+/* MB/s for scaling a buffer of BENCH_SIZE bytes over and over */
+static double bench(int fmt, int channels, int v, int ref)
+{
+	static char buf[BENCH_SIZE];
+	int frames = BENCH_SIZE / formats[fmt].size / channels;
+	int vol[MAX_CHANNELS], c;
+	unsigned long n = 0;
+	double start, t;
+
+	for (c = 0; c < channels; c++)
+		vol[c] = v;
+	fill(fmt, buf, sizeof(buf));
+	start = bench_now();
+	do {
+		int i;
+
+		for (i = 0; i < 64; i++) {
+			if (ref)
+				ref_scale(fmt, buf, frames, channels, vol, 0);
+			else
+				new_scale(fmt, buf, frames, channels, vol, 0);
+		}
+		n += 64;
+		t = bench_now() - start;
+	} while (t < 0.2);
+	return (double)n * frames * channels * formats[fmt].size / t / 1e6;
+}
+
+static const char *kernel_name(void)
+{
+#if defined(PCM_VOL_CLONES)
+	return "default code only";
+#elif defined(HAVE_TARGET_CLONES)
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2") ? "AVX2 clones" : "default clones";
+#else
+	return "no clones";
+#endif
+}
+
+int main(int argc, char *argv[])
+{
+	/* slightly below and above unity so that the data doesn't die out */
+	static const int vols[] = { 0xfff0, 0x10010 };
+	static const int channels[] = { 2, 6, 8 };
+	int fmt, c, v;
+
+	program_name = argv[0];
+
+	check_stereo();
+	check_channels();
+	printf("pcm_scale_*() (%s): %lu buffers match the old code: OK\n",
+			kernel_name(), nr_checks);
+
+	if (argc > 1 && !strcmp(argv[1], "-n"))
+		return 0;
+
+	printf("\n%-6s %8s %8s %10s %10s\n", "format", "channels", "volume", "ref MB/s", "new MB/s");
+	for (fmt = 0; fmt < NR_FORMATS; fmt++) {
+		for (c = 0; c < sizeof(channels) / sizeof(channels[0]); c++) {
+			for (v = 0; v < sizeof(vols) / sizeof(vols[0]); v++) {
+				printf("%-6s %8d %#8x %10.0f %10.0f\n", formats[fmt].name,
+						channels[c], vols[v],
+						bench(fmt, channels[c], vols[v], 1),
+						bench(fmt, channels[c], vols[v], 0));
+				fflush(stdout);
+			}
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,232 @@
+/*
+ * Copyright 2026 Various Authors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Stress test for the order statistics of the red-black tree (rbtree.c)
+ *
+ * Nodes are inserted at random positions, with rb_insert_after() and with
+ * rb_link_node() and rb_insert_color() like a search would, erased,
+ * replaced, and now and then the whole tree is rebuilt with rb_build().
+ * A plain array holds the order the tree should have.
+ *
+ * After every step the subtree sizes, the parent pointers, the colors and
+ * the black height of every path are checked, and rb_at() and rb_index()
+ * must agree with the array for every position.
+ *
+ * Usage: rbtree-stress [STEPS [MAX_NODES]]
+ *
+ * Build and run with "make check-rbtree".
+ */
+
+#include "../rbtree.h"
+#include "../prog.h"
+#include "../xmalloc.h"
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct item {
+	struct rb_node node;
+	int in_tree;
+};
+
+static uint64_t rnd_state = BENCH_RND_SEED;
+
+static struct rb_root root = RB_ROOT;
+/* the nodes in tree order */
+static struct rb_node **order;
+static unsigned long nr_nodes;
+static unsigned long step;
+
+static struct item *to_item(struct rb_node *node)
+{
+	return container_of(node, struct item, node);
+}
+
+static void order_insert(unsigned long pos, struct rb_node *node)
+{
+	memmove(order + pos + 1, order + pos, (nr_nodes - pos) * sizeof(*order));
+	order[pos] = node;
+	nr_nodes++;
+}
+
+static void order_remove(unsigned long pos)
+{
+	nr_nodes--;
+	memmove(order + pos, order + pos + 1, (nr_nodes - pos) * sizeof(*order));
+}
+
+/* returns the black height of @node, checks sizes, parents and colors */
+static int check_subtree(const struct rb_node *node, const struct rb_node *parent,
+		unsigned long *pos)
+{
+	int left, right;
+
+	if (!node)
+		return 1;
+	if (rb_parent(node) != parent)
+		die("step %lu: wrong parent\n", step);
+	if (rb_is_red(node) && parent && rb_is_red(parent))
+		die("step %lu: red node with a red parent\n", step);
+
+	left = check_subtree(node->rb_left, node, pos);
+	if (*pos >= nr_nodes || order[*pos] != node)
+		die("step %lu: node %lu out of order\n", step, *pos);
+	(*pos)++;
+	right = check_subtree(node->rb_right, node, pos);
+
+	if (left != right)
+		die("step %lu: black heights %d and %d\n", step, left, right);
+	if (node->rb_size != rb_size(node->rb_left) + rb_size(node->rb_right) + 1)
+		die("step %lu: subtree size %lu, expected %lu\n", step, node->rb_size,
+				rb_size(node->rb_left) + rb_size(node->rb_right) + 1);
+	return left + rb_is_black(node);
+}
+
+static void check_tree(void)
+{
+	unsigned long pos = 0, i;
+
+	if (root.rb_node && rb_is_red(root.rb_node))
+		die("step %lu: red root\n", step);
+	check_subtree(root.rb_node, NULL, &pos);
+	if (pos != nr_nodes || rb_count(&root) != nr_nodes)
+		die("step %lu: %lu nodes, rb_count %lu, expected %lu\n", step, pos,
+				rb_count(&root), nr_nodes);
+
+	for (i = 0; i < nr_nodes; i++) {
+		struct rb_node *node = rb_at(&root, i);
+
+		if (node != order[i])
+			die("step %lu: rb_at(%lu) is the wrong node\n", step, i);
+		if (rb_index(node) != i)
+			die("step %lu: rb_index(rb_at(%lu)) = %lu\n", step, i, rb_index(node));
+	}
+	if (rb_at(&root, nr_nodes))
+		die("step %lu: rb_at(%lu) past the end\n", step, nr_nodes);
+}
+
+/* links @node at @pos by walking down from the root */
+static void insert_at(struct rb_node *node, unsigned long pos)
+{
+	struct rb_node **link = &root.rb_node, *parent = NULL;
+
+	while (*link) {
+		unsigned long left = rb_size((*link)->rb_left);
+
+		parent = *link;
+		if (pos <= left) {
+			link = &parent->rb_left;
+		} else {
+			pos -= left + 1;
+			link = &parent->rb_right;
+		}
+	}
+	rb_link_node(node, parent, link);
+	rb_insert_color(node, &root);
+}
+
+static struct item *unused_item(struct item *items, unsigned long nr_items)
+{
+	struct item *item;
+
+	do {
+		item = &items[bench_rnd(&rnd_state) % nr_items];
+	} while (item->in_tree);
+	return item;
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned long nr_steps = 200000, max_nodes = 600, nr_items;
+	unsigned long counts[5] = {};
+	struct item *items;
+
+	program_name = argv[0];
+	if (argc > 1)
+		nr_steps = strtoul(argv[1], NULL, 10);
+	if (argc > 2)
+		max_nodes = strtoul(argv[2], NULL, 10);
+	if (max_nodes < 1)
+		die("MAX_NODES must be at least 1\n");
+
+	nr_items = max_nodes + 1;
+	items = xnew0(struct item, nr_items);
+	order = xnew(struct rb_node *, nr_items);
+
+	for (step = 0; step < nr_steps; step++) {
+		/* the size of the tree drifts between empty and max_nodes */
+		int grow = (step / (4 * max_nodes)) % 2 == 0;
+		uint32_t r = bench_rnd(&rnd_state) % 100;
+		struct item *item;
+		unsigned long pos;
+
+		if (r < 2) {
+			unsigned long i;
+
+			/* the editable views rebuild the tree after sorting */
+			for (i = 0; i < nr_nodes; i++) {
+				unsigned long j = i + bench_rnd(&rnd_state) % (nr_nodes - i);
+				struct rb_node *tmp = order[i];
+
+				order[i] = order[j];
+				order[j] = tmp;
+			}
+			rb_build(&root, order, nr_nodes);
+			counts[0]++;
+		} else if (r < 6 && nr_nodes) {
+			struct item *new = unused_item(items, nr_items);
+
+			pos = bench_rnd(&rnd_state) % nr_nodes;
+			item = to_item(order[pos]);
+			rb_replace_node(&item->node, &new->node, &root);
+			item->in_tree = 0;
+			new->in_tree = 1;
+			order[pos] = &new->node;
+			counts[1]++;
+		} else if (nr_nodes < max_nodes && (r < (grow ? 76 : 30) || !nr_nodes)) {
+			item = unused_item(items, nr_items);
+			pos = bench_rnd(&rnd_state) % (nr_nodes + 1);
+			if (r % 2) {
+				rb_insert_after(&item->node, pos ? order[pos - 1] : NULL, &root);
+				counts[2]++;
+			} else {
+				insert_at(&item->node, pos);
+				counts[3]++;
+			}
+			item->in_tree = 1;
+			order_insert(pos, &item->node);
+		} else if (nr_nodes) {
+			pos = bench_rnd(&rnd_state) % nr_nodes;
+			item = to_item(order[pos]);
+			rb_erase(&item->node, &root);
+			item->in_tree = 0;
+			order_remove(pos);
+			counts[4]++;
+		}
+		check_tree();
+	}
+
+	printf("%lu steps: %lu rb_insert_after, %lu rb_insert_color, %lu rb_erase, "
+			"%lu rb_replace_node, %lu rb_build: OK\n", nr_steps, counts[2],
+			counts[3], counts[4], counts[1], counts[0]);
+	free(order);
+	free(items);
+	return 0;
+}
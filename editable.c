@@ -24,6 +24,8 @@
 #include "filters.h"
 #include "locking.h"
 #include "mergesort.h"
+#include "parallel.h"
+#include "debug.h"
 #include "xmalloc.h"
 
 static const struct searchable_ops simple_search_ops = {
@@ -42,12 +44,45 @@ static struct simple_track *get_selected(struct editable *e)
 	return NULL;
 }
 
+static struct editable *iter_to_editable(const struct iter *iter)
+{
+	return container_of(iter->data0, struct editable, head);
+}
+
+/* rows are in the same order in the list and the tree */
+static int editable_get_index(struct iter *iter)
+{
+	struct simple_track *track = iter_to_simple_track(iter);
+
+	return rb_index(&track->tree_node);
+}
+
+static int editable_set_index(struct iter *iter, int index)
+{
+	struct rb_node *node = rb_at(&iter_to_editable(iter)->tree_root, index);
+
+	if (!node)
+		return 0;
+	iter->data1 = tree_node_to_simple_track(node);
+	iter->data2 = NULL;
+	return 1;
+}
+
+static int editable_get_count(struct iter *head)
+{
+	return rb_count(&iter_to_editable(head)->tree_root);
+}
+
 void editable_shared_init(struct editable_shared *shared,
 		editable_free_track free_track)
 {
 	shared->win = window_new(simple_track_get_prev, simple_track_get_next);
+	shared->win->get_index = editable_get_index;
+	shared->win->set_index = editable_set_index;
+	shared->win->get_count = editable_get_count;
 	shared->sort_keys = xnew(sort_key_t, 1);
 	shared->sort_keys[0] = SORT_INVALID;
+	shared->sort_keys_gen = sort_keys_gen_new();
 	shared->sort_str[0] = 0;
 	shared->free_track = free_track;
 	shared->owner = NULL;
@@ -92,7 +127,7 @@ void editable_take_ownership(struct editable *e)
 static void do_editable_add(struct editable *e, struct simple_track *track, int tiebreak)
 {
 	sorted_list_add_track(&e->head, &e->tree_root, track,
-			e->shared->sort_keys, tiebreak);
+			e->shared->sort_keys, e->shared->sort_keys_gen, tiebreak);
 	e->nr_tracks++;
 	if (track->info->duration != -1)
 		e->total_time += track->info->duration;
@@ -110,6 +145,28 @@ void editable_add_before(struct editable *e, struct simple_track *track)
 	do_editable_add(e, track, -1);
 }
 
+void editable_add_tracks(struct editable *e, struct simple_track **tracks, int nr)
+{
+	int i;
+
+	/* cheaper than relinking every track */
+	if (nr < e->nr_tracks / 8) {
+		for (i = 0; i < nr; i++)
+			editable_add(e, tracks[i]);
+		return;
+	}
+
+	sorted_list_add_tracks(&e->head, &e->tree_root, tracks, nr,
+			e->shared->sort_keys, e->shared->sort_keys_gen);
+	e->nr_tracks += nr;
+	for (i = 0; i < nr; i++) {
+		if (tracks[i]->info->duration != -1)
+			e->total_time += tracks[i]->info->duration;
+	}
+	if (editable_owns_shared(e))
+		window_changed(e->shared->win);
+}
+
 void editable_remove_track(struct editable *e, struct simple_track *track)
 {
 	struct track_info *ti = track->info;
@@ -125,6 +182,7 @@ void editable_remove_track(struct editable *e, struct simple_track *track)
 		e->total_time -= ti->duration;
 
 	sorted_list_remove_track(&e->head, &e->tree_root, track);
+	simple_track_unlink(track);
 	e->shared->free_track(e, &track->node);
 }
 
@@ -154,7 +212,8 @@ void editable_sort(struct editable *e)
 {
 	if (e->nr_tracks <= 1)
 		return;
-	sorted_list_rebuild(&e->head, &e->tree_root, e->shared->sort_keys);
+	sorted_list_rebuild(&e->head, &e->tree_root, e->shared->sort_keys,
+			e->shared->sort_keys_gen);
 
 	if (editable_owns_shared(e)) {
 		window_changed(e->shared->win);
@@ -167,6 +226,7 @@ void editable_shared_set_sort_keys(struct editable_shared *shared,
 {
 	free(shared->sort_keys);
 	shared->sort_keys = keys;
+	shared->sort_keys_gen = sort_keys_gen_new();
 }
 
 void editable_toggle_mark(struct editable *e)
@@ -194,27 +254,17 @@ static void move_item(struct editable *e, struct list_head *head, struct list_he
 	if (editable_owns_shared(e))
 		window_row_vanishes(e->shared->win, &iter);
 
+	rb_erase(&t->tree_node, &e->tree_root);
 	list_del(item);
 	list_add(item, head);
 }
 
-static void reset_tree(struct editable *e)
-{
-	struct simple_track *old, *first_track;
-
-	old = tree_node_to_simple_track(rb_first(&e->tree_root));
-	first_track = to_simple_track(e->head.next);
-	if (old != first_track) {
-		rb_replace_node(&old->tree_node, &first_track->tree_node, &e->tree_root);
-		RB_CLEAR_NODE(&old->tree_node);
-	}
-}
-
 static void move_sel(struct editable *e, struct list_head *after)
 {
 	struct simple_track *t;
 	struct list_head *item, *next;
 	struct iter iter;
+	int i, nr_moved = 0;
 	LIST_HEAD(tmp_head);
 
 	if (e->nr_marked) {
@@ -240,8 +290,19 @@ static void move_sel(struct editable *e, struct list_head *after)
 		next = item->next;
 		list_add(item, after);
 		item = next;
+		nr_moved++;
+	}
+
+	/* and to the same place in the tree */
+	item = after->next;
+	for (i = 0; i < nr_moved; i++) {
+		struct rb_node *prev = NULL;
+
+		if (item->prev != &e->head)
+			prev = &to_simple_track(item->prev)->tree_node;
+		rb_insert_after(&to_simple_track(item)->tree_node, prev, &e->tree_root);
+		item = item->next;
 	}
-	reset_tree(e);
 
 	/* select top-most of the moved tracks */
 	editable_track_to_iter(e, to_simple_track(after->next), &iter);
@@ -329,22 +390,61 @@ void editable_clear(struct editable *e)
 		editable_remove_track(e, to_simple_track(item));
 }
 
+static struct simple_track **get_tracks(struct editable *e)
+{
+	struct simple_track **tracks = xnew(struct simple_track *, e->nr_tracks + 1);
+	struct simple_track *t;
+	int i = 0;
+
+	list_for_each_entry(t, &e->head, node)
+		tracks[i++] = t;
+	BUG_ON(i != e->nr_tracks);
+	return tracks;
+}
+
+struct remove_matching {
+	struct simple_track **tracks;
+	char *match;
+	int (*cb)(void *data, struct track_info *ti);
+	void *data;
+};
+
+static void remove_matching_range(void *data, int start, int end)
+{
+	struct remove_matching *rm = data;
+	int i;
+
+	for (i = start; i < end; i++)
+		rm->match[i] = rm->cb(rm->data, rm->tracks[i]->info);
+}
+
 void editable_remove_matching_tracks(struct editable *e,
 		int (*cb)(void *data, struct track_info *ti), void *data)
 {
-	struct list_head *item, *tmp;
-
-	list_for_each_safe(item, tmp, &e->head) {
-		struct simple_track *t = to_simple_track(item);
-		if (cb(data, t->info))
-			editable_remove_track(e, t);
+	struct remove_matching rm;
+	int i, count = e->nr_tracks;
+
+	rm.tracks = get_tracks(e);
+	rm.match = xnew(char, count + 1);
+	rm.cb = cb;
+	rm.data = data;
+	parallel_for(count, remove_matching_range, &rm);
+
+	for (i = 0; i < count; i++) {
+		if (rm.match[i])
+			editable_remove_track(e, rm.tracks[i]);
 	}
+	free(rm.match);
+	free(rm.tracks);
 }
 
 void editable_mark(struct editable *e, const char *filter)
 {
 	struct expr *expr = NULL;
-	struct simple_track *t;
+	struct simple_track **tracks;
+	struct track_info **tis;
+	char *match = NULL;
+	int i, count = e->nr_tracks;
 
 	if (filter) {
 		expr = parse_filter(filter);
@@ -352,14 +452,28 @@ void editable_mark(struct editable *e, const char *filter)
 			return;
 	}
 
-	list_for_each_entry(t, &e->head, node) {
+	tracks = get_tracks(e);
+	if (expr) {
+		tis = xnew(struct track_info *, count + 1);
+		for (i = 0; i < count; i++)
+			tis[i] = tracks[i]->info;
+		match = xnew(char, count + 1);
+		expr_eval_many(expr, tis, count, match);
+		free(tis);
+	}
+
+	for (i = 0; i < count; i++) {
+		struct simple_track *t = tracks[i];
+
 		e->nr_marked -= t->marked;
 		t->marked = 0;
-		if (expr == NULL || expr_eval(expr, t->info)) {
+		if (match == NULL || match[i]) {
 			t->marked = 1;
 			e->nr_marked++;
 		}
 	}
+	free(match);
+	free(tracks);
 
 	if (editable_owns_shared(e))
 		e->shared->win->changed = 1;
@@ -426,23 +540,33 @@ int editable_for_each(struct editable *e, track_info_cb cb, void *data,
 	return simple_list_for_each(&e->head, cb, data, reverse);
 }
 
+/* the track is in the tree of @e if the root of its tree is */
+static int editable_has_track(struct editable *e, struct simple_track *track)
+{
+	struct rb_node *node = &track->tree_node;
+
+	if (RB_EMPTY_NODE(node))
+		return 0;
+	while (rb_parent(node))
+		node = rb_parent(node);
+	return node == e->tree_root.rb_node;
+}
+
 void editable_update_track(struct editable *e, struct track_info *old, struct track_info *new)
 {
-	struct list_head *item, *tmp;
+	struct simple_track *track, *next;
 	int changed = 0;
 
-	list_for_each_safe(item, tmp, &e->head) {
-		struct simple_track *track = to_simple_track(item);
-		if (track->info == old) {
-			if (new) {
-				track_info_unref(old);
-				track_info_ref(new);
-				track->info = new;
-			} else {
-				editable_remove_track(e, track);
-			}
-			changed = 1;
-		}
+	/* only the tracks with @old, not the whole list */
+	for (track = old->tracks; track; track = next) {
+		next = track->info_next;
+		if (!editable_has_track(e, track))
+			continue;
+		if (new)
+			simple_track_set_info(track, new);
+		else
+			editable_remove_track(e, track);
+		changed = 1;
 	}
 	if (editable_owns_shared(e))
 		e->shared->win->changed |= changed;
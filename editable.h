@@ -35,6 +35,8 @@ struct editable_shared {
 
 	struct window *win;
 	sort_key_t *sort_keys;
+	/* see sort_keys_gen_new() */
+	unsigned int sort_keys_gen;
 	char sort_str[128];
 	editable_free_track free_track;
 	struct searchable *searchable;
@@ -59,6 +61,8 @@ void editable_init(struct editable *e, struct editable_shared *shared,
 void editable_take_ownership(struct editable *e);
 void editable_add(struct editable *e, struct simple_track *track);
 void editable_add_before(struct editable *e, struct simple_track *track);
+/* same order as adding the tracks one by one with editable_add() */
+void editable_add_tracks(struct editable *e, struct simple_track **tracks, int nr);
 void editable_remove_track(struct editable *e, struct simple_track *track);
 void editable_remove_sel(struct editable *e);
 void editable_sort(struct editable *e);
@@ -67,6 +71,7 @@ void editable_toggle_mark(struct editable *e);
 void editable_move_after(struct editable *e);
 void editable_move_before(struct editable *e);
 void editable_clear(struct editable *e);
+/* @cb may be called on several threads at once */
 void editable_remove_matching_tracks(struct editable *e,
 		int (*cb)(void *data, struct track_info *ti), void *data);
 void editable_mark(struct editable *e, const char *filter);
@@ -27,12 +27,14 @@
 #include "list.h"
 #include "ui_curses.h" /* using_utf8, charset */
 #include "convert.h"
+#include "parallel.h"
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <ctype.h>
 #include <stdarg.h>
 #include <limits.h>
+#include <time.h>
 
 enum token_type {
 	/* special chars */
@@ -777,6 +779,8 @@ out:
 	return root;
 }
 
+static void prog_free(struct expr_prog *prog);
+
 int expr_check_leaves(struct expr **exprp, const char *(*get_filter)(const char *name))
 {
 	struct expr *expr = *exprp;
@@ -784,6 +788,10 @@ int expr_check_leaves(struct expr **exprp, const char *(*get_filter)(const char
 	const char *filter;
 	int i, rc;
 
+	/* the tree may change */
+	prog_free(expr->prog);
+	expr->prog = NULL;
+
 	if (expr->left) {
 		if (expr_check_leaves(&expr->left, get_filter))
 			return -1;
@@ -950,91 +958,680 @@ int expr_op_to_bool(int res, int op)
 	}
 }
 
-int expr_eval(struct expr *expr, struct track_info *ti)
-{
-	enum expr_type type = expr->type;
+/*
+ * Compiled expressions
+ *
+ * expr_compile() flattens the tree into a list of instructions. Keys are
+ * resolved to track_info fields at that point, so evaluating a leaf doesn't
+ * have to compare the key with every known name. & and | become jumps that
+ * skip the remaining operands when one of them decides the result already.
+ *
+ * Operands of & and | can be evaluated in any order. Chains like a & b & c
+ * are ordered so that the operands which are cheap and likely to decide the
+ * result come first. The first program is ordered by estimated cost alone.
+ * It counts how often each leaf passes during its first EXPR_SAMPLES
+ * evaluations, and the next expr_compile() call orders the chains again by
+ * cost and observed pass rate.
+ */
+
+#define EXPR_SAMPLES		1024
+
+/* leaves evaluated fewer times than this are assumed to pass half the time */
+#define EXPR_MIN_EVALS		32
+
+enum insn_type {
+	/* glob match of a string value */
+	INSN_STR,
+	/* "*text*" glob */
+	INSN_SUBSTR,
+	INSN_INT,
+	/* compares two keys, resolved by str_val() and int_val() */
+	INSN_ID,
+	INSN_STREAM,
+	INSN_TAG,
+	INSN_NOT,
+	INSN_JUMP_IF_FALSE,
+	INSN_JUMP_IF_TRUE
+};
+
+enum val_src {
+	/* keyvals_get_val() or comments_get_int() */
+	SRC_COMMENT,
+	SRC_FILENAME,
+	/* const char * or int at offset */
+	SRC_STR_FIELD,
+	SRC_INT_FIELD,
+	SRC_DURATION,
+	SRC_DATE,
+	SRC_ORIGINALDATE,
+	SRC_BITRATE
+};
+
+struct insn {
+	enum insn_type type;
+	enum val_src src;
+	/* SRC_STR_FIELD, SRC_INT_FIELD */
+	size_t offset;
+	/* SRC_COMMENT */
 	const char *key;
+	/* INSN_SUBSTR, folded with u_casefold_base_char() */
+	uchar *text;
+	int text_len;
+	/* leaves */
+	struct expr *expr;
+	/* INSN_STR, INSN_SUBSTR */
+	int negate;
+	/* INSN_INT */
+	int op;
+	int val;
+	/* INSN_JUMP_* */
+	int target;
+};
 
-	if (expr->left) {
-		int left = expr_eval(expr->left, ti);
-
-		if (type == EXPR_AND)
-			return left && expr_eval(expr->right, ti);
-		if (type == EXPR_OR)
-			return left || expr_eval(expr->right, ti);
-		/* EXPR_NOT */
-		return !left;
+struct expr_prog {
+	/* evaluations left to count in the leaves */
+	atomic_int samples_left;
+	/* ordered by the sampled pass rates */
+	int reordered;
+	int nr;
+	struct insn insns[];
+};
+
+/* these must return the same as str_val() and int_val() */
+static const struct {
+	const char *key;
+	enum val_src src;
+	size_t offset;
+} resolved_keys[] = {
+	{ "album",		SRC_STR_FIELD,	offsetof(struct track_info, album)		},
+	{ "bitrate",		SRC_BITRATE,	0						},
+	{ "bpm",		SRC_INT_FIELD,	offsetof(struct track_info, bpm)		},
+	{ "codec",		SRC_STR_FIELD,	offsetof(struct track_info, codec)		},
+	{ "codec_profile",	SRC_STR_FIELD,	offsetof(struct track_info, codec_profile)	},
+	{ "comment",		SRC_STR_FIELD,	offsetof(struct track_info, comment)		},
+	{ "date",		SRC_DATE,	0						},
+	{ "discnumber",		SRC_INT_FIELD,	offsetof(struct track_info, discnumber)		},
+	{ "duration",		SRC_DURATION,	0						},
+	{ "filename",		SRC_FILENAME,	0						},
+	{ "genre",		SRC_STR_FIELD,	offsetof(struct track_info, genre)		},
+	{ "media",		SRC_STR_FIELD,	offsetof(struct track_info, media)		},
+	{ "originaldate",	SRC_ORIGINALDATE, 0						},
+	{ "play_count",		SRC_INT_FIELD,	offsetof(struct track_info, play_count)		},
+	{ "tracknumber",	SRC_INT_FIELD,	offsetof(struct track_info, tracknumber)	},
+	{ NULL,			SRC_COMMENT,	0						}
+};
+
+static void resolve_key(struct insn *insn, const char *key)
+{
+	int i;
+
+	for (i = 0; resolved_keys[i].key; i++) {
+		if (strcmp(key, resolved_keys[i].key) == 0)
+			break;
 	}
+	insn->src = resolved_keys[i].src;
+	insn->offset = resolved_keys[i].offset;
+	insn->key = key;
+}
 
-	key = expr->key;
-	if (type == EXPR_STR) {
-		int res;
-		char *need_free;
-		const char *val = str_val(key, ti, &need_free);
-		if (!val)
-			val = "";
-		res = glob_match(&expr->estr.glob_head, val);
-		free(need_free);
-		if (expr->estr.op == SOP_EQ)
-			return res;
-		return !res;
-	} else if (type == EXPR_INT) {
-		int val = int_val(key, ti);
-		int res;
-		if (expr->eint.val == -1) {
-			/* -1 is "not set"
-			 * doesn't make sense to do 123 < "not set"
-			 * but it makes sense to do date=-1 (date is not set)
-			 */
-			if (expr->eint.op == IOP_EQ)
-				return val == -1;
-			if (expr->eint.op == IOP_NE)
-				return val != -1;
+/* rough relative cost of evaluating a leaf */
+static double leaf_cost(const struct expr *expr)
+{
+	struct insn insn;
+
+	switch (expr->type) {
+	case EXPR_STR:
+		resolve_key(&insn, expr->key);
+		if (insn.src == SRC_FILENAME)
+			return using_utf8 ? 8 : 32;
+		return insn.src == SRC_COMMENT ? 6 : 3;
+	case EXPR_INT:
+		resolve_key(&insn, expr->key);
+		return insn.src == SRC_COMMENT ? 4 : 1;
+	case EXPR_ID:
+		return 10;
+	default:
+		return 2;
+	}
+}
+
+struct operand {
+	struct expr *expr;
+	double cost;
+	double pass;
+	/* expected cost per decided result, smaller goes first */
+	double rank;
+	int idx;
+};
+
+static void estimate(struct expr *expr, int sampled, double *cost, double *pass);
+
+static int nr_operands(const struct expr *expr, enum expr_type type)
+{
+	if (expr->type != type)
+		return 1;
+	return nr_operands(expr->left, type) + nr_operands(expr->right, type);
+}
+
+static int add_operands(struct expr *expr, enum expr_type type, int sampled,
+		struct operand *ops, int n)
+{
+	if (expr->type == type) {
+		n = add_operands(expr->left, type, sampled, ops, n);
+		return add_operands(expr->right, type, sampled, ops, n);
+	}
+	ops[n].expr = expr;
+	ops[n].idx = n;
+	estimate(expr, sampled, &ops[n].cost, &ops[n].pass);
+	return n + 1;
+}
+
+static int operand_cmp(const void *a, const void *b)
+{
+	const struct operand *x = a;
+	const struct operand *y = b;
+
+	if (x->rank != y->rank)
+		return x->rank < y->rank ? -1 : 1;
+	return x->idx - y->idx;
+}
+
+/*
+ * Returns the operands of the & or | chain starting at @expr in the order
+ * they should be evaluated. The array must be freed.
+ *
+ * @sampled  use the pass rates counted by expr_eval()
+ */
+static int ordered_operands(struct expr *expr, int sampled, struct operand **opsp)
+{
+	int i, nr = nr_operands(expr, expr->type);
+	struct operand *ops = xnew(struct operand, nr);
+
+	add_operands(expr, expr->type, sampled, ops, 0);
+	for (i = 0; i < nr; i++) {
+		/* probability that the operand decides the result */
+		double decides = expr->type == EXPR_AND ? 1 - ops[i].pass : ops[i].pass;
+
+		ops[i].rank = ops[i].cost / (decides > 0.001 ? decides : 0.001);
+	}
+	qsort(ops, nr, sizeof(ops[0]), operand_cmp);
+	*opsp = ops;
+	return nr;
+}
+
+static void estimate(struct expr *expr, int sampled, double *cost, double *pass)
+{
+	struct operand *ops;
+	double reach = 1;
+	int i, nr;
+
+	switch (expr->type) {
+	case EXPR_AND:
+	case EXPR_OR:
+		nr = ordered_operands(expr, sampled, &ops);
+		*cost = 0;
+		for (i = 0; i < nr; i++) {
+			*cost += reach * ops[i].cost;
+			if (expr->type == EXPR_AND)
+				reach *= ops[i].pass;
+			else
+				reach *= 1 - ops[i].pass;
 		}
-		if (val == -1) {
-			/* tag not set, can't compare */
-			return 0;
+		*pass = expr->type == EXPR_AND ? reach : 1 - reach;
+		free(ops);
+		break;
+	case EXPR_NOT:
+		estimate(expr->left, sampled, cost, pass);
+		*pass = 1 - *pass;
+		break;
+	default:
+		{
+			unsigned int evals = atomic_load_explicit(&expr->evals, memory_order_relaxed);
+			unsigned int passes = atomic_load_explicit(&expr->passes, memory_order_relaxed);
+
+			*cost = leaf_cost(expr);
+			*pass = !sampled || evals < EXPR_MIN_EVALS ? 0.5 : (double)passes / evals;
 		}
-		res = val - expr->eint.val;
-		return expr_op_to_bool(res, expr->eint.op);
-	} else if (type == EXPR_ID) {
-		int a = 0, b = 0;
-		const char *sa, *sb;
-		char *fa, *fb;
-		int res = 0;
-		if ((sa = str_val(key, ti, &fa))) {
-			if ((sb = str_val(expr->eid.key, ti, &fb))) {
-				res = strcmp(sa, sb);
-				free(fa);
-				free(fb);
-				return expr_op_to_bool(res, expr->eid.op);
-			}
+		break;
+	}
+}
+
+static int prog_size(const struct expr *expr)
+{
+	if (!expr->left)
+		return 1;
+	if (expr->type == EXPR_NOT)
+		return prog_size(expr->left) + 1;
+	return prog_size(expr->left) + 1 + prog_size(expr->right);
+}
+
+static void compile_leaf(struct expr *expr, struct insn *insn)
+{
+	const char *text;
+
+	insn->expr = expr;
+	switch (expr->type) {
+	case EXPR_STR:
+		resolve_key(insn, expr->key);
+		insn->type = INSN_STR;
+		insn->negate = expr->estr.op != SOP_EQ;
+		text = glob_substring(&expr->estr.glob_head);
+		if (text) {
+			int idx = 0;
+
+			insn->type = INSN_SUBSTR;
+			insn->text = xnew(uchar, strlen(text));
+			while (text[idx])
+				insn->text[insn->text_len++] = u_casefold_base_char(u_get_char(text, &idx));
+		}
+		break;
+	case EXPR_INT:
+		resolve_key(insn, expr->key);
+		insn->type = INSN_INT;
+		insn->op = expr->eint.op;
+		insn->val = expr->eint.val;
+		break;
+	case EXPR_ID:
+		insn->type = INSN_ID;
+		break;
+	default:
+		insn->type = strcmp(expr->key, "stream") == 0 ? INSN_STREAM : INSN_TAG;
+		break;
+	}
+}
+
+static int compile(struct expr *expr, int sampled, struct insn *insns, int pc)
+{
+	struct operand *ops;
+	int i, nr, *jumps;
+
+	switch (expr->type) {
+	case EXPR_AND:
+	case EXPR_OR:
+		nr = ordered_operands(expr, sampled, &ops);
+		jumps = xnew(int, nr);
+		for (i = 0; i < nr; i++) {
+			pc = compile(ops[i].expr, sampled, insns, pc);
+			if (i == nr - 1)
+				break;
+			jumps[i] = pc;
+			insns[pc++].type = expr->type == EXPR_AND ?
+				INSN_JUMP_IF_FALSE : INSN_JUMP_IF_TRUE;
+		}
+		for (i = 0; i < nr - 1; i++)
+			insns[jumps[i]].target = pc;
+		free(jumps);
+		free(ops);
+		return pc;
+	case EXPR_NOT:
+		pc = compile(expr->left, sampled, insns, pc);
+		insns[pc].type = INSN_NOT;
+		return pc + 1;
+	default:
+		compile_leaf(expr, &insns[pc]);
+		return pc + 1;
+	}
+}
+
+void expr_compile(struct expr *expr)
+{
+	struct expr_prog *old = expr->prog, *prog;
+	int nr = prog_size(expr);
+
+	if (old && (old->reordered ||
+			atomic_load_explicit(&old->samples_left, memory_order_relaxed) > 0))
+		return;
+
+	prog = xmalloc(sizeof(struct expr_prog) + nr * sizeof(struct insn));
+	memset(prog->insns, 0, nr * sizeof(struct insn));
+	prog->nr = nr;
+	prog->reordered = old != NULL;
+	atomic_init(&prog->samples_left, prog->reordered ? 0 : EXPR_SAMPLES);
+	compile(expr, prog->reordered, prog->insns, 0);
+	prog_free(old);
+	expr->prog = prog;
+}
+
+static void prog_free(struct expr_prog *prog)
+{
+	int i;
+
+	if (!prog)
+		return;
+	for (i = 0; i < prog->nr; i++)
+		free(prog->insns[i].text);
+	free(prog);
+}
+
+static const char *insn_str_val(const struct insn *insn, struct track_info *ti,
+		char **need_free)
+{
+	const char *val;
+
+	*need_free = NULL;
+	switch (insn->src) {
+	case SRC_FILENAME:
+		val = ti->filename;
+		if (!using_utf8 && utf8_encode(val, charset, need_free) == 0)
+			val = *need_free;
+		break;
+	case SRC_STR_FIELD:
+		val = *(const char **)((const char *)ti + insn->offset);
+		break;
+	default:
+		val = keyvals_get_val(ti->comments, insn->key);
+		break;
+	}
+	return val ? val : "";
+}
+
+static int insn_int_val(const struct insn *insn, struct track_info *ti)
+{
+	switch (insn->src) {
+	case SRC_INT_FIELD:
+		return *(const int *)((const char *)ti + insn->offset);
+	case SRC_DURATION:
+		/* duration of a stream is infinite (well, almost) */
+		if (is_http_url(ti->filename))
+			return INT_MAX;
+		return ti->duration;
+	case SRC_DATE:
+		return (ti->date >= 0) ? (ti->date / 10000) : -1;
+	case SRC_ORIGINALDATE:
+		return (ti->originaldate >= 0) ? (ti->originaldate / 10000) : -1;
+	case SRC_BITRATE:
+		return (ti->bitrate >= 0) ? (int) (ti->bitrate / 1000. + 0.5) : -1;
+	default:
+		return comments_get_int(ti->comments, insn->key);
+	}
+}
+
+static int eval_int(const struct insn *insn, struct track_info *ti)
+{
+	int val = insn_int_val(insn, ti);
+
+	if (insn->val == -1) {
+		/* -1 is "not set"
+		 * doesn't make sense to do 123 < "not set"
+		 * but it makes sense to do date=-1 (date is not set)
+		 */
+		if (insn->op == IOP_EQ)
+			return val == -1;
+		if (insn->op == IOP_NE)
+			return val != -1;
+	}
+	if (val == -1) {
+		/* tag not set, can't compare */
+		return 0;
+	}
+	return expr_op_to_bool(val - insn->val, insn->op);
+}
+
+static int eval_id(struct expr *expr, struct track_info *ti)
+{
+	const char *key = expr->key;
+	int a = 0, b = 0;
+	const char *sa, *sb;
+	char *fa, *fb;
+	int res = 0;
+
+	if ((sa = str_val(key, ti, &fa))) {
+		if ((sb = str_val(expr->eid.key, ti, &fb))) {
+			res = strcmp(sa, sb);
 			free(fa);
-		} else {
-			a = int_val(key, ti);
-			b = int_val(expr->eid.key, ti);
-			res = a - b;
-			if (a == -1 || b == -1) {
-				switch (expr->eid.op) {
-				case KOP_EQ:
-					return res == 0;
-				case KOP_NE:
-					return res != 0;
-				default:
-					return 0;
-				}
-			}
+			free(fb);
 			return expr_op_to_bool(res, expr->eid.op);
 		}
-		return res;
+		free(fa);
+	} else {
+		a = int_val(key, ti);
+		b = int_val(expr->eid.key, ti);
+		res = a - b;
+		if (a == -1 || b == -1) {
+			switch (expr->eid.op) {
+			case KOP_EQ:
+				return res == 0;
+			case KOP_NE:
+				return res != 0;
+			default:
+				return 0;
+			}
+		}
+		return expr_op_to_bool(res, expr->eid.op);
 	}
-	if (strcmp(key, "stream") == 0)
+	return res;
+}
+
+static int eval_leaf(const struct insn *insn, struct track_info *ti)
+{
+	const char *val;
+	char *need_free;
+	int res;
+
+	switch (insn->type) {
+	case INSN_STR:
+		val = insn_str_val(insn, ti, &need_free);
+		res = glob_match(&insn->expr->estr.glob_head, val) ^ insn->negate;
+		free(need_free);
+		return res;
+	case INSN_SUBSTR:
+		val = insn_str_val(insn, ti, &need_free);
+		res = (u_strcasestr_base_folded(val, insn->text, insn->text_len) != NULL) ^ insn->negate;
+		free(need_free);
+		return res;
+	case INSN_INT:
+		return eval_int(insn, ti);
+	case INSN_ID:
+		return eval_id(insn->expr, ti);
+	case INSN_STREAM:
 		return is_http_url(ti->filename);
-	return track_info_has_tag(ti);
+	default:
+		return track_info_has_tag(ti);
+	}
+}
+
+int expr_eval(struct expr *expr, struct track_info *ti)
+{
+	struct expr_prog *prog;
+	int pc, res = 0, sample = 0;
+
+	if (!expr->prog)
+		expr_compile(expr);
+	prog = expr->prog;
+
+	if (atomic_load_explicit(&prog->samples_left, memory_order_relaxed) > 0)
+		sample = atomic_fetch_sub_explicit(&prog->samples_left, 1, memory_order_relaxed) > 0;
+
+	for (pc = 0; pc < prog->nr; pc++) {
+		const struct insn *insn = &prog->insns[pc];
+
+		switch (insn->type) {
+		case INSN_NOT:
+			res = !res;
+			break;
+		case INSN_JUMP_IF_FALSE:
+			if (!res)
+				pc = insn->target - 1;
+			break;
+		case INSN_JUMP_IF_TRUE:
+			if (res)
+				pc = insn->target - 1;
+			break;
+		default:
+			res = eval_leaf(insn, ti);
+			if (sample) {
+				atomic_fetch_add_explicit(&insn->expr->evals, 1, memory_order_relaxed);
+				if (res)
+					atomic_fetch_add_explicit(&insn->expr->passes, 1, memory_order_relaxed);
+			}
+			break;
+		}
+	}
+	return res;
+}
+
+struct eval_many {
+	struct expr *expr;
+	struct track_info **tis;
+	char *match;
+};
+
+static void eval_many_range(void *data, int start, int end)
+{
+	struct eval_many *em = data;
+	int i;
+
+	for (i = start; i < end; i++)
+		em->match[i] = expr_eval(em->expr, em->tis[i]);
+}
+
+void expr_eval_many(struct expr *expr, struct track_info **tis, int count,
+		char *match)
+{
+	struct eval_many em = { expr, tis, match };
+
+	expr_compile(expr);
+	parallel_for(count, eval_many_range, &em);
+}
+
+/*
+ * expr_explain() evaluates the tree node by node in the same order as the
+ * compiled program and measures each node.
+ */
+
+struct explain_node {
+	struct expr *expr;
+	/* leaves */
+	struct insn insn;
+	int depth;
+	/* index of the node after this subtree */
+	int next;
+	unsigned int evals;
+	unsigned int passes;
+	uint64_t ns;
+};
+
+static uint64_t explain_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static int explain_plan(struct expr *expr, int sampled,
+		struct explain_node *nodes, int n, int depth)
+{
+	struct explain_node *node = &nodes[n++];
+	struct operand *ops;
+	int i, nr;
+
+	memset(node, 0, sizeof(*node));
+	node->expr = expr;
+	node->depth = depth;
+	switch (expr->type) {
+	case EXPR_AND:
+	case EXPR_OR:
+		nr = ordered_operands(expr, sampled, &ops);
+		for (i = 0; i < nr; i++)
+			n = explain_plan(ops[i].expr, sampled, nodes, n, depth + 1);
+		free(ops);
+		break;
+	case EXPR_NOT:
+		n = explain_plan(expr->left, sampled, nodes, n, depth + 1);
+		break;
+	default:
+		compile_leaf(expr, &node->insn);
+		break;
+	}
+	node->next = n;
+	return n;
+}
+
+static int explain_eval(struct explain_node *nodes, int n, struct track_info *ti)
+{
+	struct explain_node *node = &nodes[n];
+	uint64_t start = explain_now();
+	int i, res = 0;
+
+	switch (node->expr->type) {
+	case EXPR_AND:
+	case EXPR_OR:
+		for (i = n + 1; i < node->next; i = nodes[i].next) {
+			res = explain_eval(nodes, i, ti);
+			if (res != (node->expr->type == EXPR_AND))
+				break;
+		}
+		break;
+	case EXPR_NOT:
+		res = !explain_eval(nodes, n + 1, ti);
+		break;
+	default:
+		res = eval_leaf(&node->insn, ti);
+		break;
+	}
+
+	node->ns += explain_now() - start;
+	node->evals++;
+	node->passes += res;
+	return res;
+}
+
+static void explain_label(const struct expr *expr, struct gbuf *buf)
+{
+	switch (expr->type) {
+	case EXPR_AND:
+	case EXPR_OR:
+	case EXPR_NOT:
+		gbuf_add_str(buf, expr_names[expr->type]);
+		break;
+	case EXPR_STR:
+		gbuf_addf(buf, "%s%s\"", expr->key, op_names[expr->estr.op]);
+		glob_print((struct list_head *)&expr->estr.glob_head, buf);
+		gbuf_add_ch(buf, '"');
+		break;
+	case EXPR_INT:
+		gbuf_addf(buf, "%s%s%d", expr->key, op_names[expr->eint.op], expr->eint.val);
+		break;
+	case EXPR_ID:
+		gbuf_addf(buf, "%s%s%s", expr->key, op_names[expr->eid.op], expr->eid.key);
+		break;
+	default:
+		gbuf_add_str(buf, expr->key);
+		break;
+	}
+}
+
+int expr_explain(struct expr *expr, struct track_info **tis, int count,
+		struct gbuf *buf)
+{
+	struct explain_node *nodes;
+	int i, nr, matches = 0;
+
+	expr_compile(expr);
+	nodes = xnew(struct explain_node, prog_size(expr));
+	nr = explain_plan(expr, expr->prog->reordered, nodes, 0, 0);
+	for (i = 0; i < count; i++)
+		matches += explain_eval(nodes, 0, tis[i]);
+
+	gbuf_addf(buf, "%9s %6s %10s  %s\n", "evals", "pass", "usec", "expression");
+	for (i = 0; i < nr; i++) {
+		struct explain_node *node = &nodes[i];
+		double pass = node->evals ? 100.0 * node->passes / node->evals : 0;
+
+		gbuf_addf(buf, "%9u %5.1f%% %10.1f  %*s", node->evals, pass,
+				node->ns / 1000.0, node->depth * 2, "");
+		explain_label(node->expr, buf);
+		gbuf_add_ch(buf, '\n');
+		free(node->insn.text);
+	}
+	free(nodes);
+	return matches;
 }
 
 void expr_free(struct expr *expr)
 {
+	prog_free(expr->prog);
 	if (expr->left) {
 		expr_free(expr->left);
 		if (expr->right)
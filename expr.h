@@ -21,6 +21,9 @@
 
 #include "track_info.h"
 #include "list.h"
+#include "gbuf.h"
+
+#include <stdatomic.h>
 
 enum { OP_LT, OP_LE, OP_EQ, OP_GE, OP_GT, OP_NE };
 #define NR_OPS (OP_NE + 1)
@@ -38,6 +41,8 @@ enum expr_type {
 };
 #define NR_EXPRS (EXPR_BOOL + 1)
 
+struct expr_prog;
+
 struct expr {
 	struct expr *left, *right, *parent;
 	enum expr_type type;
@@ -73,13 +78,35 @@ struct expr {
 			} op;
 		} eid;
 	};
+	/* compiled by expr_compile(), only set for the root */
+	struct expr_prog *prog;
+	/* leaves, counted by expr_eval() to order the operands of & and | */
+	atomic_uint evals;
+	atomic_uint passes;
 };
 
 struct expr *expr_parse(const char *str);
 struct expr* expr_parse_i(const char *str, const char *err_msg, int check_short);
 int expr_check_leaves(struct expr **exprp, const char *(*get_filter)(const char *name));
 int expr_op_to_bool(int res, int op);
+/*
+ * Compiles @expr unless already done, or recompiles it with the operands
+ * of & and | reordered once its first evaluations have been sampled.
+ * expr_eval() compiles on first use but never recompiles. Must not be
+ * called while another thread evaluates @expr.
+ */
+void expr_compile(struct expr *expr);
 int expr_eval(struct expr *expr, struct track_info *ti);
+/* match[i] = expr_eval(expr, tis[i]), on several threads if there are many */
+void expr_eval_many(struct expr *expr, struct track_info **tis, int count,
+		char *match);
+/*
+ * Evaluates @expr for every track in the same order as expr_eval() would and
+ * appends a line per node with its number of evaluations, pass rate and
+ * time to @buf. Returns the number of matching tracks.
+ */
+int expr_explain(struct expr *expr, struct track_info **tis, int count,
+		struct gbuf *buf);
 void expr_free(struct expr *expr);
 const char *expr_error(void);
 int expr_is_short(const char *str);
@@ -168,7 +168,7 @@ void filters_activate(int win_activate)
 
 		if (f->sel_stat == FS_NO) {
 			/* add ! */
-			struct expr *not = xnew(struct expr, 1);
+			struct expr *not = xnew0(struct expr, 1);
 
 			not->type = EXPR_NOT;
 			not->key = NULL;
@@ -179,7 +179,7 @@ void filters_activate(int win_activate)
 		if (expr == NULL) {
 			expr = e;
 		} else {
-			struct expr *and = xnew(struct expr, 1);
+			struct expr *and = xnew0(struct expr, 1);
 
 			and->type = EXPR_AND;
 			and->key = NULL;
@@ -467,6 +467,20 @@ void filters_set_anonymous(const char *val)
 	filters_win->changed = 1;
 }
 
+void filters_explain(const char *val)
+{
+	struct expr *e = NULL;
+
+	if (val) {
+		e = parse_filter(val);
+		if (e == NULL)
+			return;
+	}
+	lib_explain_filter(e);
+	if (e)
+		expr_free(e);
+}
+
 void filters_set_live(const char *val)
 {
 	lib_set_live_filter(val);
@@ -77,6 +77,12 @@ void filters_set_filter(const char *keyval);
  */
 void filters_set_anonymous(const char *val);
 
+/* show how a filter is evaluated for the library
+ *
+ * @val   filter or NULL to explain the active library filter
+ */
+void filters_explain(const char *val);
+
 /* set live filter (not saved to the filter list)
  *
  * @val   filter or NULL to disable filtering
@@ -243,3 +243,34 @@ int glob_match(struct list_head *head, const char *text)
 {
 	return do_glob_match(head, head->next, text);
 }
+
+const char *glob_substring(struct list_head *head)
+{
+	struct glob_item *items[3];
+	struct list_head *item;
+	int n = 0;
+
+	list_for_each(item, head) {
+		if (n == 3)
+			return NULL;
+		items[n++] = container_of(item, struct glob_item, node);
+	}
+	if (n != 3 || items[0]->type != GLOB_STAR ||
+			items[1]->type != GLOB_TEXT || items[2]->type != GLOB_STAR)
+		return NULL;
+	return items[1]->text;
+}
+
+void glob_print(struct list_head *head, struct gbuf *buf)
+{
+	struct glob_item *gi;
+
+	list_for_each_entry(gi, head, node) {
+		if (gi->type == GLOB_STAR)
+			gbuf_add_ch(buf, '*');
+		else if (gi->type == GLOB_QMARK)
+			gbuf_add_ch(buf, '?');
+		else
+			gbuf_add_str(buf, gi->text);
+	}
+}
@@ -20,9 +20,19 @@
 #define CMUS_GLOB_H
 
 #include "list.h"
+#include "gbuf.h"
 
 void glob_compile(struct list_head *head, const char *pattern);
 void glob_free(struct list_head *head);
 int glob_match(struct list_head *head, const char *text);
 
+/*
+ * Returns TEXT if the pattern is "*TEXT*", NULL otherwise. Such a pattern
+ * matches if u_strcasestr_base() finds TEXT.
+ */
+const char *glob_substring(struct list_head *head);
+
+/* appends the pattern to @buf, without the backslash escapes */
+void glob_print(struct list_head *head, struct gbuf *buf);
+
 #endif
@@ -0,0 +1,199 @@
+/*
+ * Copyright 2026 Various Authors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "hashtable.h"
+#include "xmalloc.h"
+#include "debug.h"
+
+#include <stdlib.h>
+
+#define HASHTABLE_MIN_SIZE	64
+
+/* slots moved from the old table per insert/remove */
+#define HASHTABLE_MOVE_STEP	32
+
+/*
+ * Marks a removed entry. Lookups have to continue past it, inserts may
+ * reuse it.
+ */
+static char deleted_dummy;
+#define DELETED ((void *)&deleted_dummy)
+
+static inline int slot_live(const struct hashtable_slot *s)
+{
+	return s->ptr && s->ptr != DELETED;
+}
+
+static void slots_insert(struct hashtable_slot *slots, uint32_t mask,
+		uint32_t hash, void *ptr, uint32_t *used)
+{
+	uint32_t pos = hash & mask;
+
+	while (slot_live(&slots[pos]))
+		pos = (pos + 1) & mask;
+
+	if (!slots[pos].ptr)
+		(*used)++;
+	slots[pos].hash = hash;
+	slots[pos].ptr = ptr;
+}
+
+static struct hashtable_slot *slots_find(struct hashtable_slot *slots, uint32_t mask,
+		uint32_t hash, hashtable_eq_cb eq, const void *key)
+{
+	uint32_t pos = hash & mask;
+
+	if (!slots)
+		return NULL;
+
+	while (slots[pos].ptr) {
+		struct hashtable_slot *s = &slots[pos];
+
+		if (s->hash == hash && s->ptr != DELETED && eq(s->ptr, key))
+			return s;
+		pos = (pos + 1) & mask;
+	}
+	return NULL;
+}
+
+static bool ptr_eq(const void *ptr, const void *key)
+{
+	return ptr == key;
+}
+
+static void move_old_slots(struct hashtable *h, uint32_t n)
+{
+	while (h->old_slots && n--) {
+		struct hashtable_slot *s = &h->old_slots[h->old_pos];
+
+		/* keep probe chains of the old table intact */
+		if (slot_live(s)) {
+			slots_insert(h->slots, h->mask, s->hash, s->ptr, &h->used);
+			s->ptr = DELETED;
+		}
+
+		if (h->old_pos++ == h->old_mask) {
+			free(h->old_slots);
+			h->old_slots = NULL;
+			h->old_mask = 0;
+			h->old_pos = 0;
+		}
+	}
+}
+
+static void start_resize(struct hashtable *h)
+{
+	uint32_t size = HASHTABLE_MIN_SIZE;
+
+	/* finish previous resize first, there can be only one old table */
+	move_old_slots(h, UINT32_MAX);
+
+	/* at most half full after all entries have been moved */
+	while (size < 2 * (h->count + 1))
+		size *= 2;
+
+	h->old_slots = h->slots;
+	h->old_mask = h->mask;
+	h->old_pos = 0;
+
+	h->slots = xnew0(struct hashtable_slot, size);
+	h->mask = size - 1;
+	h->used = 0;
+
+	if (!h->old_slots)
+		h->old_mask = 0;
+}
+
+void hashtable_insert(struct hashtable *h, uint32_t hash, void *ptr)
+{
+	BUG_ON(!ptr || ptr == DELETED);
+
+	/* keep load factor below 3/4 */
+	if (!h->slots || (h->used + 1) * 4 > (h->mask + 1) * 3)
+		start_resize(h);
+
+	slots_insert(h->slots, h->mask, hash, ptr, &h->used);
+	h->count++;
+	move_old_slots(h, HASHTABLE_MOVE_STEP);
+}
+
+void *hashtable_find(const struct hashtable *h, uint32_t hash,
+		hashtable_eq_cb eq, const void *key)
+{
+	struct hashtable_slot *s;
+
+	s = slots_find(h->slots, h->mask, hash, eq, key);
+	if (!s)
+		s = slots_find(h->old_slots, h->old_mask, hash, eq, key);
+	return s ? s->ptr : NULL;
+}
+
+bool hashtable_remove(struct hashtable *h, uint32_t hash, const void *ptr)
+{
+	struct hashtable_slot *s;
+
+	s = slots_find(h->slots, h->mask, hash, ptr_eq, ptr);
+	if (!s)
+		s = slots_find(h->old_slots, h->old_mask, hash, ptr_eq, ptr);
+	if (!s)
+		return false;
+
+	s->ptr = DELETED;
+	h->count--;
+	move_old_slots(h, HASHTABLE_MOVE_STEP);
+	return true;
+}
+
+void hashtable_clear(struct hashtable *h)
+{
+	free(h->slots);
+	free(h->old_slots);
+	*h = (struct hashtable)HASHTABLE_INIT;
+}
+
+void hashtable_iter_init(struct hashtable_iter *iter, const struct hashtable *h)
+{
+	iter->h = h;
+	iter->in_old = h->old_slots != NULL;
+	iter->pos = iter->in_old ? h->old_pos : 0;
+}
+
+void *hashtable_iter_next(struct hashtable_iter *iter)
+{
+	const struct hashtable *h = iter->h;
+
+	if (iter->in_old) {
+		while (iter->pos <= h->old_mask) {
+			struct hashtable_slot *s = &h->old_slots[iter->pos++];
+
+			if (slot_live(s))
+				return s->ptr;
+		}
+		iter->in_old = 0;
+		iter->pos = 0;
+	}
+
+	if (!h->slots)
+		return NULL;
+	while (iter->pos <= h->mask) {
+		struct hashtable_slot *s = &h->slots[iter->pos++];
+
+		if (slot_live(s))
+			return s->ptr;
+	}
+	return NULL;
+}
@@ -0,0 +1,85 @@
+/*
+ * Copyright 2026 Various Authors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CMUS_HASHTABLE_H
+#define CMUS_HASHTABLE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * Open addressing hash table of pointers.
+ *
+ * The full hash is stored next to each pointer so that the comparison
+ * callback is only called for real candidates. When the table fills up
+ * a twice as large one is allocated and the old entries are moved over
+ * a few at a time by hashtable_insert() and hashtable_remove(), so no
+ * single operation has to rehash the whole table.
+ */
+
+struct hashtable_slot {
+	uint32_t hash;
+	void *ptr;
+};
+
+struct hashtable {
+	struct hashtable_slot *slots;
+	uint32_t mask;
+	/* live and deleted slots in @slots */
+	uint32_t used;
+	/* live entries in both tables */
+	uint32_t count;
+
+	/* previous table while it is being moved to @slots */
+	struct hashtable_slot *old_slots;
+	uint32_t old_mask;
+	uint32_t old_pos;
+};
+
+struct hashtable_iter {
+	const struct hashtable *h;
+	int in_old;
+	uint32_t pos;
+};
+
+#define HASHTABLE_INIT { NULL, 0, 0, 0, NULL, 0, 0 }
+
+typedef bool (*hashtable_eq_cb)(const void *ptr, const void *key);
+
+/* does not check for duplicates */
+void hashtable_insert(struct hashtable *h, uint32_t hash, void *ptr);
+
+/* returns first entry with @hash for which @eq returns true, or NULL */
+void *hashtable_find(const struct hashtable *h, uint32_t hash,
+		hashtable_eq_cb eq, const void *key);
+
+/* removes @ptr, returns false if it wasn't found */
+bool hashtable_remove(struct hashtable *h, uint32_t hash, const void *ptr);
+
+/* removes all entries without touching them */
+void hashtable_clear(struct hashtable *h);
+
+static inline uint32_t hashtable_count(const struct hashtable *h)
+{
+	return h->count;
+}
+
+/* the table must not be modified while iterating */
+void hashtable_iter_init(struct hashtable_iter *iter, const struct hashtable *h);
+void *hashtable_iter_next(struct hashtable_iter *iter);
+
+#endif
@@ -0,0 +1,135 @@
+/*
+ * Copyright 2026 Various Authors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "intern.h"
+#include "hashtable.h"
+#include "locking.h"
+#include "xmalloc.h"
+#include "utils.h"
+#include "debug.h"
+
+#include <string.h>
+
+/* shards reduce lock contention between worker and loader threads */
+#define INTERN_SHARDS	16
+
+struct intern_str {
+	uint32_t hash;
+	uint32_t ref_count;
+	size_t len;
+	char str[];
+};
+
+struct intern_shard {
+	pthread_mutex_t mutex;
+	struct hashtable table;
+	size_t refs;
+	size_t bytes;
+	size_t ref_bytes;
+};
+
+static struct intern_shard shards[INTERN_SHARDS] = {
+	[0 ... INTERN_SHARDS - 1] = {
+		.mutex = CMUS_MUTEX_INITIALIZER,
+		.table = HASHTABLE_INIT,
+	},
+};
+
+static inline struct intern_str *to_intern_str(const char *str)
+{
+	return container_of_portable(str, struct intern_str, str);
+}
+
+static bool intern_str_eq(const void *ptr, const void *key)
+{
+	const struct intern_str *s = ptr;
+
+	return strcmp(s->str, key) == 0;
+}
+
+char *intern_get(const char *str)
+{
+	uint32_t hash = hash_str(str);
+	struct intern_shard *shard = &shards[hash % INTERN_SHARDS];
+	struct intern_str *s;
+
+	cmus_mutex_lock(&shard->mutex);
+	s = hashtable_find(&shard->table, hash, intern_str_eq, str);
+	if (!s) {
+		size_t len = strlen(str);
+
+		s = xmalloc(sizeof(*s) + len + 1);
+		s->hash = hash;
+		s->ref_count = 0;
+		s->len = len;
+		memcpy(s->str, str, len + 1);
+		hashtable_insert(&shard->table, hash, s);
+		shard->bytes += len + 1;
+	}
+	s->ref_count++;
+	shard->refs++;
+	shard->ref_bytes += s->len + 1;
+	cmus_mutex_unlock(&shard->mutex);
+	return s->str;
+}
+
+char *intern_get0(const char *str)
+{
+	return str ? intern_get(str) : NULL;
+}
+
+void intern_put(const char *str)
+{
+	struct intern_str *s;
+	struct intern_shard *shard;
+
+	if (!str)
+		return;
+
+	s = to_intern_str(str);
+	shard = &shards[s->hash % INTERN_SHARDS];
+
+	cmus_mutex_lock(&shard->mutex);
+	BUG_ON(s->ref_count == 0);
+	shard->refs--;
+	shard->ref_bytes -= s->len + 1;
+	if (--s->ref_count == 0) {
+		hashtable_remove(&shard->table, s->hash, s);
+		shard->bytes -= s->len + 1;
+		free(s);
+	}
+	cmus_mutex_unlock(&shard->mutex);
+}
+
+void intern_get_stats(struct intern_stats *stats)
+{
+	size_t ref_bytes = 0;
+	int i;
+
+	memset(stats, 0, sizeof(*stats));
+	for (i = 0; i < INTERN_SHARDS; i++) {
+		struct intern_shard *shard = &shards[i];
+
+		cmus_mutex_lock(&shard->mutex);
+		stats->strings += hashtable_count(&shard->table);
+		stats->refs += shard->refs;
+		stats->bytes += shard->bytes;
+		ref_bytes += shard->ref_bytes;
+		cmus_mutex_unlock(&shard->mutex);
+	}
+	stats->saved = ref_bytes - stats->bytes;
+}
@@ -0,0 +1,50 @@
+/*
+ * Copyright 2026 Various Authors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CMUS_INTERN_H
+#define CMUS_INTERN_H
+
+#include <stddef.h>
+
+/*
+ * Refcounted pool of immutable strings. Equal strings share one copy,
+ * which is freed when the last reference is dropped. Thread safe.
+ */
+
+struct intern_stats {
+	/* distinct strings in the pool */
+	size_t strings;
+	/* references to them */
+	size_t refs;
+	/* bytes used by the distinct strings */
+	size_t bytes;
+	/* bytes the references would use as separate copies, minus @bytes */
+	size_t saved;
+};
+
+/* returns shared copy of @str, must be released with intern_put() */
+char *intern_get(const char *str);
+
+/* same as intern_get() but NULL-safe */
+char *intern_get0(const char *str);
+
+/* drops a reference returned by intern_get(), NULL is ignored */
+void intern_put(const char *str);
+
+void intern_get_stats(struct intern_stats *stats);
+
+#endif
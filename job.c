@@ -38,6 +38,8 @@
 #include "cue_utils.h"
 #include "pl_env.h"
 #include "misc.h"
+#include "stat_sweep.h"
+#include "options.h"
 
 #include <string.h>
 #include <unistd.h>
@@ -170,7 +172,15 @@ static void add_file(const char *filename, int force)
 	struct track_info *ti;
 
 	if (!is_cue_url(filename)) {
-		if (force || lookup_cache_entry(filename, hash_str(filename)) == NULL) {
+		int cached = 0;
+
+		if (!force) {
+			/* lookup may materialize a lazily loaded cache entry */
+			cache_lock();
+			cached = lookup_cache_entry(filename, hash_str(filename)) != NULL;
+			cache_unlock();
+		}
+		if (!cached) {
 			int done = add_file_cue(filename);
 			if (done)
 				return;
@@ -353,6 +363,154 @@ static void handle_cue_files(struct ptr_array *files)
 	free(to_remove);
 }
 
+/* files are handed to the tag readers in batches of this size */
+#define IMPORT_BATCH 32
+
+enum import_state {
+	IMPORT_PENDING,
+	/* cached, a cue sheet, or cancelled: left to add_file() */
+	IMPORT_SKIPPED,
+	IMPORT_READ,
+};
+
+struct import_file {
+	const char *filename;
+	/* NULL if reading failed */
+	struct track_info *ti;
+	enum import_state state;
+};
+
+struct import_pool {
+	struct import_file *files;
+	int count;
+	/* first file not handed out yet */
+	int next;
+	pthread_mutex_t mutex;
+	/* signalled when a file is done or a reader exits */
+	pthread_cond_t cond;
+};
+
+static void *import_reader(void *data)
+{
+	struct import_pool *p = data;
+	int need[IMPORT_BATCH];
+	int i, start, end;
+
+	while (!worker_cancelling()) {
+		cmus_mutex_lock(&p->mutex);
+		start = p->next;
+		end = min_i(start + IMPORT_BATCH, p->count);
+		p->next = end;
+		cmus_mutex_unlock(&p->mutex);
+		if (start == end)
+			break;
+
+		// one lock for the whole batch
+		cache_lock();
+		for (i = start; i < end; i++) {
+			const char *filename = p->files[i].filename;
+
+			need[i - start] = !is_cue(filename) && cache_needs_read(filename);
+		}
+		cache_unlock();
+
+		for (i = start; i < end; i++) {
+			struct import_file *f = &p->files[i];
+			struct track_info *ti = NULL;
+			int read = need[i - start] && !worker_cancelling();
+
+			if (read)
+				ti = cache_read_ti(f->filename);
+
+			cmus_mutex_lock(&p->mutex);
+			f->ti = ti;
+			f->state = read ? IMPORT_READ : IMPORT_SKIPPED;
+			pthread_cond_broadcast(&p->cond);
+			cmus_mutex_unlock(&p->mutex);
+		}
+	}
+
+	cmus_mutex_lock(&p->mutex);
+	pthread_cond_broadcast(&p->cond);
+	cmus_mutex_unlock(&p->mutex);
+	return NULL;
+}
+
+/*
+ * Reads tags of uncached files on @nr_threads threads. The results are
+ * added in the order of @files.
+ */
+static void add_files_parallel(char **files, int count, int nr_threads)
+{
+	struct import_pool p = {};
+	pthread_t threads[64];
+	int i, j, n, started = 0;
+
+	p.files = xnew0(struct import_file, count);
+	for (i = 0; i < count; i++)
+		p.files[i].filename = files[i];
+	p.count = count;
+	pthread_mutex_init(&p.mutex, NULL);
+	pthread_cond_init(&p.cond, NULL);
+
+	nr_threads = min_i(nr_threads, N_ELEMENTS(threads));
+	for (i = 0; i < nr_threads; i++) {
+		if (pthread_create(&threads[started], NULL, import_reader, &p))
+			break;
+		started++;
+	}
+	// nothing to wait for without readers
+	if (!started) {
+		for (i = 0; i < count; i++)
+			p.files[i].state = IMPORT_SKIPPED;
+	}
+
+	i = 0;
+	while (i < count) {
+		struct import_file *f = &p.files[i];
+
+		cmus_mutex_lock(&p.mutex);
+		while (f->state == IMPORT_PENDING && !worker_cancelling())
+			pthread_cond_wait(&p.cond, &p.mutex);
+		// consecutive results which can be added under one cache lock
+		for (n = 0; i + n < count; n++) {
+			if (p.files[i + n].state != IMPORT_READ)
+				break;
+		}
+		cmus_mutex_unlock(&p.mutex);
+		if (worker_cancelling())
+			break;
+
+		if (!n) {
+			add_file(f->filename, 0);
+			i++;
+			continue;
+		}
+
+		cache_lock();
+		for (j = i; j < i + n; j++) {
+			struct import_file *r = &p.files[j];
+
+			if (r->ti) {
+				add_ti(cache_add_ti(r->ti));
+				r->ti = NULL;
+			}
+		}
+		cache_unlock();
+		i += n;
+	}
+
+	for (i = 0; i < started; i++)
+		pthread_join(threads[i], NULL);
+	for (i = 0; i < count; i++) {
+		if (p.files[i].ti)
+			track_info_unref(p.files[i].ti);
+	}
+	pthread_cond_destroy(&p.cond);
+	pthread_mutex_destroy(&p.mutex);
+	free(p.files);
+}
+
 static void add_dir(const char *dirname, const char *root)
 {
 	PTR_ARRAY(files);
@@ -364,18 +522,28 @@ static void add_dir(const char *dirname, const char *root)
 
 	handle_cue_files(&files);
 
-	int i;
+	int i, n = 0, nr_threads;
 	char **ents = files.ptrs;
+	char **order = xnew(char *, files.count + 1);
 	if (jd->add == play_queue_prepend) {
-		for (i = files.count - 1; i >= 0 && !worker_cancelling(); i--)
+		for (i = files.count - 1; i >= 0; i--)
 			if (ents[i])
-				add_file(ents[i], 0);
+				order[n++] = ents[i];
 	} else {
-		for (i = 0; i < files.count && !worker_cancelling(); i++)
+		for (i = 0; i < files.count; i++)
 			if (ents[i])
-				add_file(ents[i], 0);
+				order[n++] = ents[i];
+	}
+
+	nr_threads = import_threads ? import_threads : get_nr_cpus();
+	if (nr_threads > 1 && n > IMPORT_BATCH) {
+		add_files_parallel(order, n, nr_threads);
+	} else {
+		for (i = 0; i < n && !worker_cancelling(); i++)
+			add_file(order[i], 0);
 	}
 
+	free(order);
 	ptr_array_clear(&files);
 }
 
@@ -404,9 +572,6 @@ static void add_pl(const char *filename)
 	int reverse;
 
 	buf = mmap_file(filename, &size);
-	if (size == -1)
-		return;
-
 	if (buf) {
 		char *cwd = xstrjoin(filename, "/..");
 		/* beautiful hack */
@@ -415,8 +580,9 @@ static void add_pl(const char *filename)
 		cmus_playlist_for_each(buf, size, reverse, handle_line, cwd);
 		free(cwd);
 		munmap(buf, size);
-		add_ti(NULL); // marks end of load
 	}
+	/* marks end of load, also for missing or empty files */
+	add_ti(NULL);
 }
 
 static void do_add_job(void *data)
@@ -474,19 +640,22 @@ static void do_update_job(void *data)
 	struct update_data *d = data;
 	int i;
 	enum update_kind *kind = xnew(enum update_kind, d->used);
+	struct stat_sweep_entry *st = xnew(struct stat_sweep_entry, d->used);
 	struct job_result *res;
 
+	for (i = 0; i < d->used; i++)
+		st[i].filename = d->ti[i]->filename;
+	stat_sweep(st, d->used);
+
 	for (i = 0; i < d->used; i++) {
 		struct track_info *ti = d->ti[i];
-		struct stat s;
-		int rc;
+		int rc = st[i].err;
 
-		rc = stat(ti->filename, &s);
-		if (rc || d->force || ti->mtime != s.st_mtime || ti->duration == 0) {
+		if (rc || d->force || ti->mtime != st[i].mtime || ti->duration == 0) {
 			kind[i] = UPDATE_NONE;
 			if (!is_cue_url(ti->filename) && !is_http_url(ti->filename) && rc)
 				kind[i] |= UPDATE_REMOVE;
-			else if (ti->mtime != s.st_mtime)
+			else if (ti->mtime != st[i].mtime)
 				kind[i] |= UPDATE_MTIME_CHANGED;
 		} else {
 			track_info_unref(ti);
@@ -504,6 +673,7 @@ static void do_update_job(void *data)
 	job_push_result(res);
 
 	d->ti = NULL;
+	free(st);
 }
 
 static void free_update_job(void *data)
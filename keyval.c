@@ -19,6 +19,7 @@
 #include "debug.h"
 #include "keyval.h"
 #include "xmalloc.h"
+#include "intern.h"
 
 #include <strings.h>
 
@@ -62,6 +63,32 @@ void keyvals_free(struct keyval *keyvals)
 	free(keyvals);
 }
 
+void keyvals_intern(struct keyval *keyvals)
+{
+	int i;
+
+	for (i = 0; keyvals[i].key; i++) {
+		char *key = intern_get(keyvals[i].key);
+		char *val = intern_get(keyvals[i].val);
+
+		free(keyvals[i].key);
+		free(keyvals[i].val);
+		keyvals[i].key = key;
+		keyvals[i].val = val;
+	}
+}
+
+void keyvals_free_interned(struct keyval *keyvals)
+{
+	int i;
+
+	for (i = 0; keyvals[i].key; i++) {
+		intern_put(keyvals[i].key);
+		intern_put(keyvals[i].val);
+	}
+	free(keyvals);
+}
+
 const char *keyvals_get_val(const struct keyval *keyvals, const char *key)
 {
 	int i;
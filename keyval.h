@@ -38,6 +38,9 @@ void keyvals_add(struct growing_keyvals *c, const char *key, char *val);
 const char *keyvals_get_val_growing(const struct growing_keyvals *c, const char *key);
 void keyvals_terminate(struct growing_keyvals *c);
 void keyvals_free(struct keyval *keyvals);
+/* replace keys and values with interned copies, see intern.h */
+void keyvals_intern(struct keyval *keyvals);
+void keyvals_free_interned(struct keyval *keyvals);
 struct keyval *keyvals_dup(const struct keyval *keyvals);
 const char *keyvals_get_val(const struct keyval *keyvals, const char *key);
 
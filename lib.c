@@ -25,7 +25,12 @@
 #include "debug.h"
 #include "utils.h"
 #include "u_collate.h"
-#include "ui_curses.h" /* cur_view */
+#include "hashtable.h"
+#include "watch.h"
+#include "text_index.h"
+#include "parallel.h"
+#include "gbuf.h"
+#include "ui_curses.h" /* cur_view, info_msg() */
 
 #include <pthread.h>
 #include <string.h>
@@ -46,6 +51,11 @@ static struct expr *add_filter = NULL;
 static int remove_from_hash = 1;
 
 static struct expr *live_filter_expr = NULL;
+/* text_index is built when the live filter is used for the first time */
+static int text_index_built = 0;
+/* tracks that can match lib_live_filter, if the text index could narrow it down */
+static struct hashtable live_filter_tis = HASHTABLE_INIT;
+static int live_filter_narrowed = 0;
 static struct track_info *cur_track_ti = NULL;
 static struct track_info *sel_track_ti = NULL;
 
@@ -89,7 +99,66 @@ static void album_shuffle_list_remove(struct album *album)
 	rb_erase(&album->shuffle_info.tree_node, &lib_album_shuffle_root);
 }
 
-static void views_add_track(struct track_info *ti)
+/*
+ * tracks in the views that have a title, keyed by artist, album, disc
+ * number, track number and title for ignore_duplicates
+ */
+static struct hashtable dup_hash = HASHTABLE_INIT;
+
+struct dup_key {
+	const char *artist_collkey;
+	const char *album_collkey;
+	const struct track_info *ti;
+};
+
+static uint32_t dup_key_hash(const struct dup_key *key)
+{
+	const struct track_info *ti = key->ti;
+	uint32_t hash = hash_str(key->artist_collkey);
+
+	hash = hash * 31 + hash_str(key->album_collkey);
+	hash = hash * 31 + hash_str(ti->collkey_title);
+	hash = hash * 31 + (uint32_t)ti->discnumber;
+	hash = hash * 31 + (uint32_t)ti->tracknumber;
+	return hash;
+}
+
+static bool dup_key_eq(const void *ptr, const void *key)
+{
+	const struct tree_track *track = ptr;
+	const struct track_info *ti = tree_track_info(track);
+	const struct dup_key *k = key;
+
+	return ti->tracknumber == k->ti->tracknumber
+		&& ti->discnumber == k->ti->discnumber
+		&& strcmp(ti->collkey_title, k->ti->collkey_title) == 0
+		&& strcmp(track->album->collkey_name, k->album_collkey) == 0
+		&& strcmp(track->album->artist->collkey_name, k->artist_collkey) == 0;
+}
+
+static void dup_insert(struct tree_track *track)
+{
+	struct dup_key key;
+
+	key.ti = tree_track_info(track);
+	if (!key.ti->collkey_title)
+		return;
+
+	/* the album and artist already have the collation keys */
+	key.artist_collkey = track->album->artist->collkey_name;
+	key.album_collkey = track->album->collkey_name;
+	track->dup_hash = dup_key_hash(&key);
+	hashtable_insert(&dup_hash, track->dup_hash, track);
+}
+
+static void dup_remove(struct tree_track *track)
+{
+	if (tree_track_info(track)->collkey_title)
+		hashtable_remove(&dup_hash, track->dup_hash, track);
+}
+
+static struct tree_track *views_add_tree_track(struct track_info *ti,
+		void (*add_album_cb)(struct album *))
 {
 	struct tree_track *track = xnew(struct tree_track, 1);
 
@@ -99,140 +168,242 @@ static void views_add_track(struct track_info *ti)
 	/* both the hash table and views have refs */
 	track_info_ref(ti);
 
-	tree_add_track(track, album_shuffle_list_add);
+	tree_add_track(track, add_album_cb);
+	dup_insert(track);
+	return track;
+}
+
+static void views_add_track(struct track_info *ti)
+{
+	struct tree_track *track = views_add_tree_track(ti, album_shuffle_list_add);
+
 	shuffle_add(track);
 	editable_add(&lib_editable, (struct simple_track *)track);
 }
 
-struct fh_entry {
-	struct fh_entry *next;
+/*
+ * Adding many tracks at once: the tree is filled track by track, but the
+ * shuffle lists and the sorted view are built once at the end, see
+ * views_add_tracks_end().
+ */
+static struct tree_track **new_tracks;
+static int nr_new_tracks, alloc_new_tracks;
+static struct shuffle_info **new_albums;
+static int nr_new_albums, alloc_new_albums;
+
+static void album_shuffle_list_add_later(struct album *album)
+{
+	if (nr_new_albums == alloc_new_albums) {
+		alloc_new_albums = alloc_new_albums ? alloc_new_albums * 2 : 64;
+		new_albums = xrenew(struct shuffle_info *, new_albums, alloc_new_albums);
+	}
+	album->shuffle_info.album = album;
+	new_albums[nr_new_albums++] = &album->shuffle_info;
+}
+
+static void views_add_track_later(struct track_info *ti)
+{
+	struct tree_track *track = views_add_tree_track(ti, album_shuffle_list_add_later);
 
-	/* ref count is increased when added to this hash */
-	struct track_info *ti;
-};
+	if (nr_new_tracks == alloc_new_tracks) {
+		alloc_new_tracks = alloc_new_tracks ? alloc_new_tracks * 2 : 1024;
+		new_tracks = xrenew(struct tree_track *, new_tracks, alloc_new_tracks);
+	}
+	new_tracks[nr_new_tracks++] = track;
+}
+
+static void views_add_tracks_end(void)
+{
+	struct shuffle_info **infos = xnew(struct shuffle_info *, nr_new_tracks);
+	int i;
+
+	for (i = 0; i < nr_new_tracks; i++) {
+		infos[i] = &new_tracks[i]->simple_track.shuffle_info;
+		infos[i]->album = new_tracks[i]->album;
+	}
+	shuffle_list_add_many(infos, nr_new_tracks, &lib_shuffle_root);
+	shuffle_list_add_many(new_albums, nr_new_albums, &lib_album_shuffle_root);
+	editable_add_tracks(&lib_editable, (struct simple_track **)new_tracks, nr_new_tracks);
+	free(infos);
+
+	free(new_tracks);
+	new_tracks = NULL;
+	nr_new_tracks = alloc_new_tracks = 0;
+	free(new_albums);
+	new_albums = NULL;
+	nr_new_albums = alloc_new_albums = 0;
+}
 
-#define FH_SIZE (1024)
-static struct fh_entry *ti_hash[FH_SIZE] = { NULL, };
+/* all track_infos of the library keyed by filename, each has a ref */
+static struct hashtable ti_hash = HASHTABLE_INIT;
+
+static bool ti_filename_eq(const void *ptr, const void *key)
+{
+	const struct track_info *ti = ptr;
+
+	return strcmp(ti->filename, key) == 0;
+}
 
 static int hash_insert(struct track_info *ti)
 {
 	const char *filename = ti->filename;
-	unsigned int pos = hash_str(filename) % FH_SIZE;
-	struct fh_entry **entryp;
-	struct fh_entry *e;
-
-	entryp = &ti_hash[pos];
-	e = *entryp;
-	while (e) {
-		if (strcmp(e->ti->filename, filename) == 0) {
-			/* found, don't insert */
-			return 0;
-		}
-		e = e->next;
+	uint32_t hash = hash_str(filename);
+
+	if (hashtable_find(&ti_hash, hash, ti_filename_eq, filename)) {
+		/* found, don't insert */
+		return 0;
 	}
 
-	e = xnew(struct fh_entry, 1);
 	track_info_ref(ti);
-	e->ti = ti;
-	e->next = *entryp;
-	*entryp = e;
+	hashtable_insert(&ti_hash, hash, ti);
+	if (text_index_built)
+		text_index_add(ti);
+	/* is_filtered() checks it anyway */
+	if (live_filter_narrowed)
+		hashtable_insert(&live_filter_tis, hash_ptr(ti), ti);
 	return 1;
 }
 
 static void hash_remove(struct track_info *ti)
 {
 	const char *filename = ti->filename;
-	unsigned int pos = hash_str(filename) % FH_SIZE;
-	struct fh_entry **entryp;
-
-	entryp = &ti_hash[pos];
-	while (1) {
-		struct fh_entry *e = *entryp;
-
-		BUG_ON(e == NULL);
-		if (strcmp(e->ti->filename, filename) == 0) {
-			*entryp = e->next;
-			track_info_unref(e->ti);
-			free(e);
-			break;
-		}
-		entryp = &e->next;
-	}
+	uint32_t hash = hash_str(filename);
+	struct track_info *e;
+
+	e = hashtable_find(&ti_hash, hash, ti_filename_eq, filename);
+	BUG_ON(e == NULL);
+	hashtable_remove(&ti_hash, hash, e);
+	if (text_index_built)
+		text_index_remove(e);
+	if (live_filter_narrowed)
+		hashtable_remove(&live_filter_tis, hash_ptr(e), e);
+	track_info_unref(e);
+}
+
+static bool ti_ptr_eq(const void *ptr, const void *key)
+{
+	return ptr == key;
+}
+
+static int live_filter_matches(struct track_info *ti)
+{
+	if (live_filter_narrowed &&
+			!hashtable_find(&live_filter_tis, hash_ptr(ti), ti_ptr_eq, ti))
+		return 0;
+	return track_info_matches(ti, lib_live_filter, TI_MATCH_ALL);
 }
 
 static int is_filtered(struct track_info *ti)
 {
 	if (live_filter_expr && !expr_eval(live_filter_expr, ti))
 		return 1;
-	if (!live_filter_expr && lib_live_filter && !track_info_matches(ti, lib_live_filter, TI_MATCH_ALL))
+	if (!live_filter_expr && lib_live_filter && !live_filter_matches(ti))
 		return 1;
 	if (filter && !expr_eval(filter, ti))
 		return 1;
 	return 0;
 }
 
-static bool track_exists(struct track_info *ti)
+/* is_filtered() can then run on several threads */
+static void compile_filters(void)
 {
-	struct rb_node *node;
-	struct artist *artist;
-	struct album *album;
-	struct tree_track *track;
+	if (live_filter_expr)
+		expr_compile(live_filter_expr);
+	if (filter)
+		expr_compile(filter);
+}
 
-	if (!ti->collkey_title)
-		return false;
+struct filtered_many {
+	struct track_info **tis;
+	char *filtered;
+};
 
-	char *artist_collkey_name = u_strcasecoll_key(tree_artist_name(ti));
-	rb_for_each_entry(artist, node, &lib_artist_root, tree_node) {
-		if (strcmp(artist->collkey_name, artist_collkey_name) == 0)
-			break;
-	}
-	free(artist_collkey_name);
+static void is_filtered_range(void *data, int start, int end)
+{
+	struct filtered_many *fm = data;
+	int i;
 
-	if (!artist)
-		return false;
+	for (i = start; i < end; i++)
+		fm->filtered[i] = is_filtered(fm->tis[i]);
+}
 
-	char *album_collkey_name = u_strcasecoll_key(tree_album_name(ti));
-	rb_for_each_entry(album, node, &artist->album_root, tree_node) {
-		if (strcmp(album->collkey_name, album_collkey_name) == 0)
-			break;
-	}
-	free(album_collkey_name);
+/* filtered[i] = is_filtered(tis[i]) */
+static void is_filtered_many(struct track_info **tis, int count, char *filtered)
+{
+	struct filtered_many fm = { tis, filtered };
 
-	if (!album)
+	compile_filters();
+	parallel_for(count, is_filtered_range, &fm);
+}
+
+static bool track_exists(struct track_info *ti)
+{
+	char *artist_collkey_name, *album_collkey_name;
+	struct dup_key key;
+	bool found;
+
+	if (!ti->collkey_title)
 		return false;
 
-	rb_for_each_entry(track, node, &album->track_root, tree_node) {
-		struct track_info *iter_ti = tree_track_info(track);
-		if (iter_ti->tracknumber == ti->tracknumber
-				&& iter_ti->discnumber == ti->discnumber
-				&& iter_ti->collkey_title && strcmp(iter_ti->collkey_title, ti->collkey_title) == 0)
-			return true;
-	}
-	return false;
+	artist_collkey_name = u_strcasecoll_key(tree_artist_name(ti));
+	album_collkey_name = u_strcasecoll_key(tree_album_name(ti));
+	key.artist_collkey = artist_collkey_name;
+	key.album_collkey = album_collkey_name;
+	key.ti = ti;
+	found = hashtable_find(&dup_hash, dup_key_hash(&key), dup_key_eq, &key) != NULL;
+	free(artist_collkey_name);
+	free(album_collkey_name);
+	return found;
 }
 
-void lib_add_track(struct track_info *ti, void *opaque)
+/* adds @ti to the hash table if it is accepted to the library */
+static int lib_accept_track(struct track_info *ti)
 {
-	if (!ti)
-		return;
-
 	if (add_filter && !expr_eval(add_filter, ti)) {
 		/* filter any files excluded by lib_add_filter */
-		return;
+		return 0;
 	}
 
 	if (ignore_duplicates && track_exists(ti))
-		return;
+		return 0;
 
 	if (!hash_insert(ti)) {
 		/* duplicate files not allowed */
-		return;
+		return 0;
 	}
+	watch_add_track(ti->filename);
+	return 1;
+}
 
-	if (!is_filtered(ti))
+void lib_add_track(struct track_info *ti, void *opaque)
+{
+	if (!ti)
+		return;
+
+	/* tracks are added one at a time, reorder the filters as they are sampled */
+	if (add_filter)
+		expr_compile(add_filter);
+	compile_filters();
+
+	if (lib_accept_track(ti) && !is_filtered(ti))
 		views_add_track(ti);
 }
 
+void lib_add_tracks(struct track_info **tis, int count)
+{
+	int i;
+
+	if (add_filter)
+		expr_compile(add_filter);
+	compile_filters();
+
+	for (i = 0; i < count; i++) {
+		if (lib_accept_track(tis[i]) && !is_filtered(tis[i]))
+			views_add_track_later(tis[i]);
+	}
+	views_add_tracks_end();
+}
+
 static struct tree_track *album_first_track(const struct album *album)
 {
 	return to_tree_track(rb_first(&album->track_root));
@@ -460,6 +631,7 @@ static void free_lib_track(struct editable *e, struct list_head *item)
 		hash_remove(ti);
 
 	rb_erase(&track->simple_track.shuffle_info.tree_node, &lib_shuffle_root);
+	dup_remove(track);
 	tree_remove(track, album_shuffle_list_remove);
 
 	track_info_unref(ti);
@@ -626,19 +798,30 @@ struct track_info *sorted_activate_selected(void)
 
 static void hash_add_to_views(void)
 {
-	int i;
-	for (i = 0; i < FH_SIZE; i++) {
-		struct fh_entry *e;
-
-		e = ti_hash[i];
-		while (e) {
-			struct track_info *ti = e->ti;
-
-			if (!is_filtered(ti) && !(ignore_duplicates && track_exists(ti)))
-				views_add_track(ti);
-			e = e->next;
-		}
+	/* no need to look at tracks which can't match the live filter */
+	struct hashtable *h = live_filter_narrowed ? &live_filter_tis : &ti_hash;
+	struct hashtable_iter iter;
+	struct track_info *ti, **tis;
+	char *filtered;
+	int i, count = 0;
+
+	tis = xnew(struct track_info *, hashtable_count(h) + 1);
+	hashtable_iter_init(&iter, h);
+	while ((ti = hashtable_iter_next(&iter)))
+		tis[count++] = ti;
+
+	/* the filters are evaluated in parallel, the views are not thread safe */
+	filtered = xnew(char, count + 1);
+	is_filtered_many(tis, count, filtered);
+	for (i = 0; i < count; i++) {
+		ti = tis[i];
+		if (!filtered[i] && !(ignore_duplicates && track_exists(ti)))
+			views_add_track_later(ti);
 	}
+	views_add_tracks_end();
+
+	free(filtered);
+	free(tis);
 }
 
 struct tree_track *lib_find_track(struct track_info *ti)
@@ -694,8 +877,10 @@ static void do_lib_filter(int clear_before)
 	if (clear_before) {
 		editable_clear(&lib_editable);
 		hash_add_to_views();
-	} else
+	} else {
+		compile_filters();
 		editable_remove_matching_tracks(&lib_editable, is_filtered_cb, NULL);
+	}
 	remove_from_hash = 1;
 
 	window_changed(lib_editable.shared->win);
@@ -714,6 +899,24 @@ static void unset_live_filter(void)
 	lib_live_filter = NULL;
 	free(live_filter_expr);
 	live_filter_expr = NULL;
+	hashtable_clear(&live_filter_tis);
+	live_filter_narrowed = 0;
+}
+
+static void narrow_live_filter(void)
+{
+	if (!text_index_built) {
+		struct hashtable_iter iter;
+		struct track_info *ti;
+		uint64_t t = timer_get();
+
+		hashtable_iter_init(&iter, &ti_hash);
+		while ((ti = hashtable_iter_next(&iter)))
+			text_index_add(ti);
+		text_index_built = 1;
+		timer_print("text index", timer_get() - t);
+	}
+	live_filter_narrowed = text_index_lookup(lib_live_filter, &live_filter_tis);
 }
 
 void lib_set_filter(struct expr *expr)
@@ -726,6 +929,32 @@ void lib_set_filter(struct expr *expr)
 	do_lib_filter(clear_before);
 }
 
+void lib_explain_filter(struct expr *expr)
+{
+	struct hashtable_iter iter;
+	struct track_info *ti, **tis;
+	int count = 0, matches;
+	GBUF(buf);
+
+	if (!expr)
+		expr = filter;
+	if (!expr) {
+		info_msg("no filter to explain");
+		return;
+	}
+
+	tis = xnew(struct track_info *, hashtable_count(&ti_hash) + 1);
+	hashtable_iter_init(&iter, &ti_hash);
+	while ((ti = hashtable_iter_next(&iter)))
+		tis[count++] = ti;
+	matches = expr_explain(expr, tis, count, &buf);
+	free(tis);
+
+	gbuf_addf(&buf, "%d of %d tracks match", matches, count);
+	info_msg("%s", buf.buffer);
+	gbuf_free(&buf);
+}
+
 void lib_set_add_filter(struct expr *expr)
 {
 	if (add_filter)
@@ -816,6 +1045,8 @@ void lib_set_live_filter(const char *str)
 	unset_live_filter();
 	lib_live_filter = str ? xstrdup(str) : NULL;
 	live_filter_expr = expr;
+	if (lib_live_filter && !live_filter_expr)
+		narrow_live_filter();
 	do_lib_filter(clear_before);
 
 	if (expr) {
@@ -831,6 +1062,11 @@ void lib_set_live_filter(const char *str)
 		restore_sel_track();
 }
 
+struct track_info *lib_find_ti(const char *filename)
+{
+	return hashtable_find(&ti_hash, hash_str(filename), ti_filename_eq, filename);
+}
+
 int lib_remove(struct track_info *ti)
 {
 	struct simple_track *track;
@@ -846,20 +1082,15 @@ int lib_remove(struct track_info *ti)
 
 void lib_clear_store(void)
 {
-	int i;
-
-	for (i = 0; i < FH_SIZE; i++) {
-		struct fh_entry *e, *next;
+	struct hashtable_iter iter;
+	struct track_info *ti;
 
-		e = ti_hash[i];
-		while (e) {
-			next = e->next;
-			track_info_unref(e->ti);
-			free(e);
-			e = next;
-		}
-		ti_hash[i] = NULL;
-	}
+	hashtable_iter_init(&iter, &ti_hash);
+	while ((ti = hashtable_iter_next(&iter)))
+		track_info_unref(ti);
+	hashtable_clear(&ti_hash);
+	text_index_clear();
+	hashtable_clear(&live_filter_tis);
 }
 
 void sorted_sel_current(void)
@@ -882,25 +1113,29 @@ static int ti_cmp(const void *a, const void *b)
 
 static int do_lib_for_each(int (*cb)(void *data, struct track_info *ti), void *data, int filtered)
 {
-	int i, rc = 0, count = 0, size = 1024;
+	int i, rc = 0, count = 0;
+	struct hashtable_iter iter;
 	struct track_info **tis;
+	struct track_info *ti;
 
-	tis = xnew(struct track_info *, size);
+	tis = xnew(struct track_info *, hashtable_count(&ti_hash) + 1);
 
 	/* collect all track_infos */
-	for (i = 0; i < FH_SIZE; i++) {
-		struct fh_entry *e;
-
-		e = ti_hash[i];
-		while (e) {
-			if (count == size) {
-				size *= 2;
-				tis = xrenew(struct track_info *, tis, size);
-			}
-			if (!filtered || !filter || expr_eval(filter, e->ti))
-				tis[count++] = e->ti;
-			e = e->next;
+	hashtable_iter_init(&iter, &ti_hash);
+	while ((ti = hashtable_iter_next(&iter)))
+		tis[count++] = ti;
+
+	if (filtered && filter) {
+		char *match = xnew(char, count + 1);
+		int n = 0;
+
+		expr_eval_many(filter, tis, count, match);
+		for (i = 0; i < count; i++) {
+			if (match[i])
+				tis[n++] = tis[i];
 		}
+		count = n;
+		free(match);
 	}
 
 	/* sort to speed up playlist loading */
@@ -32,6 +32,9 @@ struct tree_track {
 	struct rb_node tree_node;
 
 	struct album *album;
+
+	/* hash in the duplicate index of lib.c */
+	uint32_t dup_hash;
 };
 
 static inline struct track_info *tree_track_info(const struct tree_track *track)
@@ -63,6 +66,9 @@ struct album {
 	int date;
 	/* min date of the tracks added to this album */
 	int min_date;
+	/* of the tracks in track_root, unknown durations count as 0 */
+	int duration;
+	unsigned int nr_tracks;
 };
 
 struct artist {
@@ -79,6 +85,10 @@ struct artist {
 	char *collkey_sort_name;
 	char *collkey_auto_sort_name;
 
+	/* of the tracks of all albums in album_root */
+	int duration;
+	unsigned int nr_tracks;
+
 	/* albums visible for this artist in the tree_win? */
 	unsigned int expanded : 1;
 	unsigned int is_compilation : 1;
@@ -116,7 +126,11 @@ struct track_info *lib_goto_prev(void);
 struct track_info *lib_goto_next_album(void);
 struct track_info *lib_goto_prev_album(void);
 void lib_add_track(struct track_info *track_info, void *opaque);
+/* same as lib_add_track() for each track, but builds the views in one go */
+void lib_add_tracks(struct track_info **tis, int count);
 void lib_set_filter(struct expr *expr);
+/* prints per node statistics of @expr, or of the current filter if NULL */
+void lib_explain_filter(struct expr *expr);
 void lib_set_live_filter(const char *str);
 void lib_set_add_filter(struct expr *expr);
 int lib_remove(struct track_info *ti);
@@ -130,6 +144,8 @@ int lib_for_each_filtered(int (*cb)(void *data, struct track_info *ti),
 		void *data, void *opaque);
 
 struct tree_track *lib_find_track(struct track_info *ti);
+/* returns the library track_info of @filename, without a reference */
+struct track_info *lib_find_ti(const char *filename);
 struct track_info *lib_set_track(struct tree_track *track);
 void lib_store_cur_track(struct track_info *ti);
 struct track_info *lib_get_cur_stored_track(void);
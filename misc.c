@@ -361,3 +361,10 @@ void shuffle_array(void *array, size_t n, size_t size)
 		memcpy(arr + i * size, tmp, size);
 	}
 }
+
+int get_nr_cpus(void)
+{
+	long n = sysconf(_SC_NPROCESSORS_ONLN);
+
+	return n > 0 ? n : 1;
+}
@@ -51,4 +51,7 @@ int replaygain_decode(unsigned int field, int *gain);
 char *expand_filename(const char *name);
 void shuffle_array(void *array, size_t n, size_t size);
 
+/* number of online CPUs, at least 1 */
+int get_nr_cpus(void);
+
 #endif
@@ -26,7 +26,7 @@
 #include <fcntl.h>
 #endif
 
-#define OP_ABI_VERSION 3
+#define OP_ABI_VERSION 4
 
 enum {
 	/* no error */
@@ -62,6 +62,13 @@ struct output_plugin_ops {
 	int (*pause)(void);
 	int (*unpause)(void);
 
+	/*
+	 * waits at most @ms milliseconds for buffer_space() to become
+	 * non-zero. called with the consumer lock held, so it must not
+	 * block for longer than that.
+	 */
+	int (*wait)(int ms);
+
 };
 
 #define OPT(prefix, name) { #name, prefix ## _set_ ## name, \
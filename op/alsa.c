@@ -289,6 +289,16 @@ static int op_alsa_buffer_space(void)
 	return f * alsa_frame_size;
 }
 
+static int op_alsa_wait(int ms)
+{
+	int rc = snd_pcm_wait(alsa_handle, ms);
+
+	/* xruns are recovered from by op_alsa_buffer_space() */
+	if (rc < 0)
+		return alsa_error_to_op_error(rc);
+	return 0;
+}
+
 static int op_alsa_pause(void)
 {
 	int rc = 0;
@@ -357,6 +367,7 @@ const struct output_plugin_ops op_pcm_ops = {
 	.buffer_space = op_alsa_buffer_space,
 	.pause = op_alsa_pause,
 	.unpause = op_alsa_unpause,
+	.wait = op_alsa_wait,
 };
 
 const struct output_plugin_opt op_pcm_options[] = {
@@ -41,6 +41,7 @@
 #include "debug.h"
 #include "discid.h"
 #include "mpris.h"
+#include "watch.h"
 #ifdef HAVE_CONFIG
 #include "config/curses.h"
 #endif
@@ -81,6 +82,10 @@ int scroll_offset = 2;
 int rewind_offset = 5;
 int skip_track_info = 0;
 int ignore_duplicates = 0;
+int intern_tags = 1;
+int import_threads = 0;
+int watch_library = 0;
+int watch_limit = 8192;
 int auto_expand_albums_follow = 1;
 int auto_expand_albums_search = 1;
 int auto_expand_albums_selcur = 1;
@@ -1235,6 +1240,66 @@ static void toggle_ignore_duplicates(void *data)
 	ignore_duplicates ^= 1;
 }
 
+static void get_intern_tags(void *data, char *buf, size_t size)
+{
+	strscpy(buf, bool_names[intern_tags], size);
+}
+
+static void set_intern_tags(void *data, const char *buf)
+{
+	parse_bool(buf, &intern_tags);
+}
+
+static void toggle_intern_tags(void *data)
+{
+	intern_tags ^= 1;
+}
+
+static void get_watch_library(void *data, char *buf, size_t size)
+{
+	strscpy(buf, bool_names[watch_library], size);
+}
+
+static void set_watch_library(void *data, const char *buf)
+{
+	parse_bool(buf, &watch_library);
+	watch_reset();
+}
+
+static void toggle_watch_library(void *data)
+{
+	watch_library ^= 1;
+	watch_reset();
+}
+
+static void get_watch_limit(void *data, char *buf, size_t size)
+{
+	buf_int(buf, watch_limit, size);
+}
+
+static void set_watch_limit(void *data, const char *buf)
+{
+	int n;
+
+	if (parse_int(buf, 0, 1000000, &n)) {
+		watch_limit = n;
+		watch_reset();
+	}
+}
+
+static void get_import_threads(void *data, char *buf, size_t size)
+{
+	buf_int(buf, import_threads, size);
+}
+
+static void set_import_threads(void *data, const char *buf)
+{
+	int n;
+
+	if (parse_int(buf, 0, 64, &n))
+		import_threads = n;
+}
+
 void update_mouse(void)
 {
 	if (mouse) {
@@ -1674,6 +1739,10 @@ static const struct {
 	DT(wrap_search)
 	DT(skip_track_info)
 	DT(ignore_duplicates)
+	DT(intern_tags)
+	DN(import_threads)
+	DT(watch_library)
+	DN(watch_limit)
 	DT(mouse)
 	DT(mpris)
 	DT(time_show_leading_zero)
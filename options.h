@@ -169,6 +169,10 @@ extern int scroll_offset;
 extern int rewind_offset;
 extern int skip_track_info;
 extern int ignore_duplicates;
+extern int intern_tags;
+extern int import_threads;
+extern int watch_library;
+extern int watch_limit;
 extern int mouse;
 extern int mpris;
 extern int time_show_leading_zero;
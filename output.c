@@ -298,6 +298,13 @@ int op_buffer_space(void)
 	return op->pcm_ops->buffer_space();
 }
 
+int op_wait(int ms)
+{
+	if (op->pcm_ops->wait == NULL)
+		return -OP_ERROR_NOT_SUPPORTED;
+	return op->pcm_ops->wait(ms);
+}
+
 int mixer_set_volume(int left, int right)
 {
 	if (op == NULL)
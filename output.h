@@ -76,6 +76,13 @@ int op_unpause(void);
  */
 int op_buffer_space(void);
 
+/*
+ * waits at most @ms milliseconds for space in the output buffer
+ *
+ * errors: OP_ERROR_{}, OP_ERROR_NOT_SUPPORTED if the plugin can't wait
+ */
+int op_wait(int ms);
+
 /*
  * errors: OP_ERROR_{}
  */
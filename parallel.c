@@ -0,0 +1,81 @@
+/*
+ * Copyright 2026 Various Authors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "parallel.h"
+#include "misc.h"
+#include "utils.h"
+#include "debug.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+
+/* smaller ranges cost more in thread startup than they save */
+#define PARALLEL_MIN_RANGE	2048
+#define PARALLEL_MAX_THREADS	16
+
+struct parallel {
+	parallel_cb cb;
+	void *data;
+	int count;
+	int range;
+	atomic_int next;
+};
+
+static void *parallel_thread(void *arg)
+{
+	struct parallel *p = arg;
+
+	while (1) {
+		int start = atomic_fetch_add(&p->next, p->range);
+
+		if (start >= p->count)
+			break;
+		p->cb(p->data, start, min_i(start + p->range, p->count));
+	}
+	return NULL;
+}
+
+void parallel_for(int count, parallel_cb cb, void *data)
+{
+	pthread_t threads[PARALLEL_MAX_THREADS];
+	struct parallel p;
+	int i, nr_threads, started = 0;
+
+	nr_threads = min_i(get_nr_cpus(), PARALLEL_MAX_THREADS);
+	nr_threads = min_i(nr_threads, count / PARALLEL_MIN_RANGE);
+	if (nr_threads <= 1) {
+		if (count > 0)
+			cb(data, 0, count);
+		return;
+	}
+
+	p.cb = cb;
+	p.data = data;
+	p.count = count;
+	/* a few ranges per thread so that a slow range doesn't hold up the rest */
+	p.range = max_i(PARALLEL_MIN_RANGE, count / (nr_threads * 4));
+	atomic_init(&p.next, 0);
+
+	for (i = 1; i < nr_threads; i++) {
+		if (pthread_create(&threads[started], NULL, parallel_thread, &p))
+			break;
+		started++;
+	}
+	parallel_thread(&p);
+	for (i = 0; i < started; i++)
+		pthread_join(threads[i], NULL);
+}
@@ -0,0 +1,33 @@
+/*
+ * Copyright 2026 Various Authors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CMUS_PARALLEL_H
+#define CMUS_PARALLEL_H
+
+typedef void (*parallel_cb)(void *data, int start, int end);
+
+/*
+ * Calls @cb for consecutive ranges [start, end) that together cover
+ * [0, @count), on up to one thread per CPU. The calling thread takes part
+ * and the function returns when all ranges are done. Small counts are not
+ * worth starting threads for and are handled by the calling thread alone.
+ *
+ * @cb must only read shared state or write to its own range.
+ */
+void parallel_for(int count, parallel_cb cb, void *data);
+
+#endif
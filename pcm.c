@@ -17,10 +17,13 @@
  */
 
 #include "pcm.h"
+#include "channelmap.h"
 #include "utils.h"
+#include "config/pcm.h"
 
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 
 /*
  * Functions to convert PCM to 16-bit signed little-endian stereo
@@ -177,3 +180,263 @@ pcm_conv_in_place_func pcm_conv_in_place[8] = {
 	swap_s16_byte_order,
 #endif
 };
+
+/*
+ * Soft volume
+ *
+ * There are no branches per sample so that the compiler can vectorize the
+ * loops. Samples are processed in blocks of VOL_BLOCK, a partial block at
+ * the end goes through a copy so that there is only one loop to vectorize.
+ * Where the toolchain supports it an AVX2 clone of each function is built
+ * too and picked at load time on CPUs that have it.
+ *
+ * The volume of each sample of a block is looked up from a table that
+ * repeats the volumes of the channels. A block that starts at channel c
+ * uses the table from index c, so the table doesn't depend on the number
+ * of channels being a divisor of VOL_BLOCK.
+ *
+ * A volume of at most PCM_VOL_SCALE can't overflow the sample format, so
+ * clamping is only done when replaygain makes it bigger.
+ */
+
+#define VOL_BLOCK 16
+
+/* contrib/pcm-bench builds the default path on its own with -DPCM_VOL_CLONES= */
+#ifndef PCM_VOL_CLONES
+#if defined(HAVE_TARGET_CLONES)
+#define PCM_VOL_CLONES __attribute__((target_clones("avx2", "default")))
+#else
+#define PCM_VOL_CLONES
+#endif
+#endif
+
+struct vol_table {
+	int vol[VOL_BLOCK + CHANNELS_MAX - 1];
+	int channels;
+	/* VOL_BLOCK % channels */
+	int step;
+	int clamp;
+};
+
+/* returns 0 if all channels are at PCM_VOL_SCALE and there's nothing to do */
+static int vol_table_init(struct vol_table *t, int channels, const int *vol)
+{
+	int i, unity = 1;
+
+	t->channels = channels;
+	t->step = VOL_BLOCK % channels;
+	t->clamp = 0;
+	for (i = 0; i < channels; i++) {
+		unity &= vol[i] == PCM_VOL_SCALE;
+		t->clamp |= vol[i] > PCM_VOL_SCALE;
+	}
+	for (i = 0; i < VOL_BLOCK + channels - 1; i++)
+		t->vol[i] = vol[i % channels];
+	return !unity;
+}
+
+static inline int vol_table_next(const struct vol_table *t, int c)
+{
+	c += t->step;
+	return c < t->channels ? c : c - t->channels;
+}
+
+/* x / PCM_VOL_SCALE, rounded half away from zero */
+static inline int32_t vol_round32(int32_t x)
+{
+	return (x + PCM_VOL_SCALE / 2 - (x < 0)) >> PCM_VOL_SHIFT;
+}
+
+static inline int64_t vol_round64(int64_t x)
+{
+	return (x + PCM_VOL_SCALE / 2 - (x < 0)) >> PCM_VOL_SHIFT;
+}
+
+static inline int64_t clamp64(int64_t x, int64_t min, int64_t max)
+{
+	x = x < min ? min : x;
+	return x > max ? max : x;
+}
+
+static inline int32_t scale_s16(int32_t x, int vol, int clamp)
+{
+	if (clamp)
+		return clamp64(vol_round64((int64_t)x * vol), INT16_MIN, INT16_MAX);
+	/* -32768 * 65536 still fits */
+	return vol_round32(x * vol);
+}
+
+static inline void scale_s16_block(int16_t *b, const int *vol, int swap, int clamp)
+{
+	int j;
+
+	for (j = 0; j < VOL_BLOCK; j++) {
+		int32_t s = swap ? (int16_t)swap_uint16(b[j]) : b[j];
+
+		s = scale_s16(s, vol[j], clamp);
+		b[j] = swap ? swap_uint16(s) : s;
+	}
+}
+
+static inline void scale_s16_samples(int16_t *buf, int count,
+		const struct vol_table *t, int swap, int clamp)
+{
+	int i, c = 0;
+
+	for (i = 0; i + VOL_BLOCK <= count; i += VOL_BLOCK) {
+		scale_s16_block(buf + i, t->vol + c, swap, clamp);
+		c = vol_table_next(t, c);
+	}
+	if (i < count) {
+		int16_t tail[VOL_BLOCK] = { 0 };
+
+		memcpy(tail, buf + i, (count - i) * 2);
+		scale_s16_block(tail, t->vol + c, swap, clamp);
+		memcpy(buf + i, tail, (count - i) * 2);
+	}
+}
+
+PCM_VOL_CLONES
+void pcm_scale_s16(void *buf, int frames, int channels, const int *vol, int swap)
+{
+	struct vol_table t;
+	int count = frames * channels;
+
+	if (!vol_table_init(&t, channels, vol))
+		return;
+
+	if (swap) {
+		if (t.clamp)
+			scale_s16_samples(buf, count, &t, 1, 1);
+		else
+			scale_s16_samples(buf, count, &t, 1, 0);
+	} else {
+		if (t.clamp)
+			scale_s16_samples(buf, count, &t, 0, 1);
+		else
+			scale_s16_samples(buf, count, &t, 0, 0);
+	}
+}
+
+static inline int32_t scale_s24(int32_t x, int vol, int clamp)
+{
+	int64_t s = vol_round64((int64_t)x * vol);
+
+	if (clamp)
+		s = clamp64(s, -0x800000, 0x7fffff);
+	return s;
+}
+
+static inline int32_t read_s24le(const uint8_t *b)
+{
+	return b[0] | b[1] << 8 | (int8_t)b[2] * 65536;
+}
+
+static inline void write_s24le(uint8_t *b, int32_t x)
+{
+	b[0] = x;
+	b[1] = x >> 8;
+	b[2] = x >> 16;
+}
+
+static inline void scale_s24le_block(uint8_t *b, const int *vol, int clamp)
+{
+	int j;
+
+	for (j = 0; j < VOL_BLOCK; j++)
+		write_s24le(b + j * 3, scale_s24(read_s24le(b + j * 3), vol[j], clamp));
+}
+
+static inline void scale_s24le_samples(uint8_t *buf, int count,
+		const struct vol_table *t, int clamp)
+{
+	int i, c = 0;
+
+	for (i = 0; i + VOL_BLOCK <= count; i += VOL_BLOCK) {
+		scale_s24le_block(buf + i * 3, t->vol + c, clamp);
+		c = vol_table_next(t, c);
+	}
+	if (i < count) {
+		uint8_t tail[VOL_BLOCK * 3] = { 0 };
+
+		memcpy(tail, buf + i * 3, (count - i) * 3);
+		scale_s24le_block(tail, t->vol + c, clamp);
+		memcpy(buf + i * 3, tail, (count - i) * 3);
+	}
+}
+
+PCM_VOL_CLONES
+void pcm_scale_s24le(void *buf, int frames, int channels, const int *vol)
+{
+	struct vol_table t;
+	int count = frames * channels;
+
+	if (!vol_table_init(&t, channels, vol))
+		return;
+
+	if (t.clamp)
+		scale_s24le_samples(buf, count, &t, 1);
+	else
+		scale_s24le_samples(buf, count, &t, 0);
+}
+
+static inline int32_t scale_s32(int32_t x, int vol, int clamp)
+{
+	int64_t s = vol_round64((int64_t)x * vol);
+
+	if (clamp)
+		s = clamp64(s, INT32_MIN, INT32_MAX);
+	return s;
+}
+
+static inline void scale_s32_block(int32_t *b, const int *vol, int swap, int clamp)
+{
+	int j;
+
+	for (j = 0; j < VOL_BLOCK; j++) {
+		int32_t s = swap ? (int32_t)swap_uint32(b[j]) : b[j];
+
+		s = scale_s32(s, vol[j], clamp);
+		b[j] = swap ? swap_uint32(s) : s;
+	}
+}
+
+static inline void scale_s32_samples(int32_t *buf, int count,
+		const struct vol_table *t, int swap, int clamp)
+{
+	int i, c = 0;
+
+	for (i = 0; i + VOL_BLOCK <= count; i += VOL_BLOCK) {
+		scale_s32_block(buf + i, t->vol + c, swap, clamp);
+		c = vol_table_next(t, c);
+	}
+	if (i < count) {
+		int32_t tail[VOL_BLOCK] = { 0 };
+
+		memcpy(tail, buf + i, (count - i) * 4);
+		scale_s32_block(tail, t->vol + c, swap, clamp);
+		memcpy(buf + i, tail, (count - i) * 4);
+	}
+}
+
+PCM_VOL_CLONES
+void pcm_scale_s32(void *buf, int frames, int channels, const int *vol, int swap)
+{
+	struct vol_table t;
+	int count = frames * channels;
+
+	if (!vol_table_init(&t, channels, vol))
+		return;
+
+	if (swap) {
+		if (t.clamp)
+			scale_s32_samples(buf, count, &t, 1, 1);
+		else
+			scale_s32_samples(buf, count, &t, 1, 0);
+	} else {
+		if (t.clamp)
+			scale_s32_samples(buf, count, &t, 0, 1);
+		else
+			scale_s32_samples(buf, count, &t, 0, 0);
+	}
+}
@@ -25,4 +25,19 @@ typedef void (*pcm_conv_in_place_func)(void *buf, int count);
 extern pcm_conv_func pcm_conv[8];
 extern pcm_conv_in_place_func pcm_conv_in_place[8];
 
+#define PCM_VOL_SHIFT 16
+#define PCM_VOL_SCALE (1 << PCM_VOL_SHIFT)
+
+/*
+ * Scale interleaved samples in place, channel c by @vol[c] / PCM_VOL_SCALE.
+ * Results are rounded half away from zero and clamped to the range of the
+ * sample format.
+ *
+ * @channels: 1..CHANNELS_MAX
+ * @swap:     samples are in the opposite of host byte order
+ */
+void pcm_scale_s16(void *buf, int frames, int channels, const int *vol, int swap);
+void pcm_scale_s24le(void *buf, int frames, int channels, const int *vol);
+void pcm_scale_s32(void *buf, int frames, int channels, const int *vol, int swap);
+
 #endif
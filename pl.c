@@ -30,6 +30,7 @@
 #include "worker.h"
 #include "uchar.h"
 #include "mergesort.h"
+#include "profile.h"
 
 #include <unistd.h>
 #include <stdio.h>
@@ -602,9 +603,13 @@ static void pl_delete_selected_track(void)
 
 void pl_init(void)
 {
+	uint64_t t;
+
 	editable_shared_init(&pl_editable_shared, pl_free_track);
 
+	t = profile_get();
 	pl_load_all();
+	profile_phase("pl_load_all", t);
 	if (list_empty(&pl_head))
 		pl_create_default();
 
@@ -630,7 +635,10 @@ void pl_init_options(void)
 
 void pl_exit(void)
 {
+	uint64_t t = profile_get();
+
 	pl_save_all();
+	profile_phase("pl_save_all", t);
 }
 
 void pl_save(void)
@@ -21,6 +21,7 @@
 #include "input.h"
 #include "output.h"
 #include "sf.h"
+#include "pcm.h"
 #include "op.h"
 #include "utils.h"
 #include "xmalloc.h"
@@ -30,6 +31,7 @@
 #include "mpris.h"
 #include "cmus.h"
 #include "lib.h"
+#include "cache.h"
 #include "pl_env.h"
 #include "ui_curses.h"
 
@@ -41,6 +43,7 @@
 #include <sys/time.h>
 #include <stdarg.h>
 #include <math.h>
+#include <stdatomic.h>
 
 const char * const player_status_names[] = {
 	"stopped", "playing", "paused", NULL
@@ -78,6 +81,13 @@ static struct player_info player_info_priv = {
 	.buffer_fill_changed = 0,
 };
 
+/*
+ * tracks played to the end since the last player_save_play_counts().
+ * the consumer must not wait for cache I/O. protected by player_info_mutex
+ */
+static struct track_info **played_tis;
+static int nr_played_tis, played_tis_alloc;
+
 /* continue playing after track is finished? */
 int player_cont = 1;
 
@@ -100,7 +110,13 @@ static CHANNEL_MAP(buffer_channel_map);
 
 static pthread_t producer_thread;
 static pthread_mutex_t producer_mutex = CMUS_MUTEX_INITIALIZER;
+/*
+ * broadcast whenever the producer status changes or the producer fills a
+ * chunk, and when the consumer frees a chunk while the producer waits
+ */
 static pthread_cond_t producer_playing = CMUS_COND_INITIALIZER;
+/* the producer waits for the consumer to free a chunk */
+static atomic_bool producer_waiting;
 static int producer_running = 1;
 static enum producer_status producer_status = PS_UNLOADED;
 static struct input_plugin *ip = NULL;
@@ -165,7 +181,7 @@ static void set_buffer_sf(void)
 	}
 }
 
-#define SOFT_VOL_SCALE 65536
+#define SOFT_VOL_SCALE PCM_VOL_SCALE
 
 /* coefficients for volumes 0..99, for 100 65536 is used
  * data copied from alsa-lib src/pcm/pcm_softvol.c
@@ -186,53 +202,6 @@ static const unsigned short soft_vol_db[100] = {
 	0xcdf1, 0xd71a, 0xe59c, 0xefd3
 };
 
-static inline void scale_sample_int16_t(int16_t *buf, int i, int vol, int swap)
-{
-	int32_t sample = swap ? (int16_t)swap_uint16(buf[i]) : buf[i];
-
-	if (sample < 0) {
-		sample = (sample * vol - SOFT_VOL_SCALE / 2) / SOFT_VOL_SCALE;
-		if (sample < INT16_MIN)
-			sample = INT16_MIN;
-	} else {
-		sample = (sample * vol + SOFT_VOL_SCALE / 2) / SOFT_VOL_SCALE;
-		if (sample > INT16_MAX)
-			sample = INT16_MAX;
-	}
-	buf[i] = swap ? swap_uint16(sample) : sample;
-}
-
-static inline int32_t scale_sample_s24le(int32_t s, int vol)
-{
-	int64_t sample = s;
-	if (sample < 0) {
-		sample = (sample * vol - SOFT_VOL_SCALE / 2) / SOFT_VOL_SCALE;
-		if (sample < -0x800000)
-			sample = -0x800000;
-	} else {
-		sample = (sample * vol + SOFT_VOL_SCALE / 2) / SOFT_VOL_SCALE;
-		if (sample > 0x7fffff)
-			sample = 0x7fffff;
-	}
-	return sample;
-}
-
-static inline void scale_sample_int32_t(int32_t *buf, int i, int vol, int swap)
-{
-	int64_t sample = swap ? (int32_t)swap_uint32(buf[i]) : buf[i];
-
-	if (sample < 0) {
-		sample = (sample * vol - SOFT_VOL_SCALE / 2) / SOFT_VOL_SCALE;
-		if (sample < INT32_MIN)
-			sample = INT32_MIN;
-	} else {
-		sample = (sample * vol + SOFT_VOL_SCALE / 2) / SOFT_VOL_SCALE;
-		if (sample > INT32_MAX)
-			sample = INT32_MAX;
-	}
-	buf[i] = swap ? swap_uint32(sample) : sample;
-}
-
 static inline int sf_need_swap(sample_format_t sf)
 {
 #ifdef WORDS_BIGENDIAN
@@ -242,68 +211,40 @@ static inline int sf_need_swap(sample_format_t sf)
 #endif
 }
 
-#define SCALE_SAMPLES(TYPE, buffer, count, l, r, swap)				\
-{										\
-	const int frames = count / sizeof(TYPE) / 2;				\
-	TYPE *buf = (void *) buffer;						\
-	int i;									\
-	/* avoid underflowing -32768 to 32767 when scale is 65536 */		\
-	if (l != SOFT_VOL_SCALE && r != SOFT_VOL_SCALE) {			\
-		for (i = 0; i < frames; i++) {					\
-			scale_sample_##TYPE(buf, i * 2, l, swap);		\
-			scale_sample_##TYPE(buf, i * 2 + 1, r, swap);		\
-		}								\
-	} else if (l != SOFT_VOL_SCALE) {					\
-		for (i = 0; i < frames; i++)					\
-			scale_sample_##TYPE(buf, i * 2, l, swap);		\
-	} else if (r != SOFT_VOL_SCALE) {					\
-		for (i = 0; i < frames; i++)					\
-			scale_sample_##TYPE(buf, i * 2 + 1, r, swap);		\
-	}									\
-}
-
-static inline int32_t read_s24le(const char *buf)
-{
-	const unsigned char *b = (const unsigned char *) buf;
-	return b[0] | (b[1] << 8) | (((const signed char *) buf)[2] << 16);
-}
-
-static inline void write_s24le(char *buf, int32_t x)
-{
-	unsigned char *b = (unsigned char *) buf;
-	b[0] = x;
-	b[1] = x >> 8;
-	b[2] = x >> 16;
-}
-
-static void scale_samples_s24le(char *buf, unsigned int count, int l, int r)
+/*
+ * Channels on the left get the left volume, channels on the right the right
+ * volume. Everything in the middle (mono, center, LFE) is heard from both
+ * sides and gets the louder of the two, so that balance only ever attenuates
+ * one side.
+ */
+static int channel_soft_vol(channel_position_t pos, int l, int r)
 {
-	int frames = count / 3 / 2;
-	if (l != SOFT_VOL_SCALE && r != SOFT_VOL_SCALE) {
-		while (frames--) {
-			write_s24le(buf, scale_sample_s24le(read_s24le(buf), l));
-			buf += 3;
-			write_s24le(buf, scale_sample_s24le(read_s24le(buf), r));
-			buf += 3;
-		}
-	} else if (l != SOFT_VOL_SCALE) {
-		while (frames--) {
-			write_s24le(buf, scale_sample_s24le(read_s24le(buf), l));
-			buf += 3 * 2;
-		}
-	} else if (r != SOFT_VOL_SCALE) {
-		buf += 3;
-		while (frames--) {
-			write_s24le(buf, scale_sample_s24le(read_s24le(buf), r));
-			buf += 3 * 2;
-		}
+	switch (pos) {
+	case CHANNEL_POSITION_FRONT_LEFT:
+	case CHANNEL_POSITION_REAR_LEFT:
+	case CHANNEL_POSITION_FRONT_LEFT_OF_CENTER:
+	case CHANNEL_POSITION_SIDE_LEFT:
+	case CHANNEL_POSITION_TOP_FRONT_LEFT:
+	case CHANNEL_POSITION_TOP_REAR_LEFT:
+		return l;
+	case CHANNEL_POSITION_FRONT_RIGHT:
+	case CHANNEL_POSITION_REAR_RIGHT:
+	case CHANNEL_POSITION_FRONT_RIGHT_OF_CENTER:
+	case CHANNEL_POSITION_SIDE_RIGHT:
+	case CHANNEL_POSITION_TOP_FRONT_RIGHT:
+	case CHANNEL_POSITION_TOP_REAR_RIGHT:
+		return r;
+	default:
+		return l > r ? l : r;
 	}
 }
 
 static void scale_samples(char *buffer, unsigned int *countp)
 {
 	unsigned int count = *countp;
-	int ch, bits, l, r;
+	int vol[CHANNELS_MAX];
+	CHANNEL_MAP(map);
+	int i, ch, bits, l, r, frames;
 
 	BUG_ON(scale_pos < consumer_pos);
 
@@ -322,7 +263,7 @@ static void scale_samples(char *buffer, unsigned int *countp)
 
 	ch = sf_get_channels(buffer_sf);
 	bits = sf_get_bits(buffer_sf);
-	if (ch != 2 || (bits != 16 && bits != 24 && bits != 32))
+	if (ch < 1 || ch > CHANNELS_MAX || (bits != 16 && bits != 24 && bits != 32))
 		return;
 
 	l = SOFT_VOL_SCALE;
@@ -335,16 +276,24 @@ static void scale_samples(char *buffer, unsigned int *countp)
 	l *= replaygain_scale;
 	r *= replaygain_scale;
 
+	if (channel_map_valid(buffer_channel_map))
+		channel_map_copy(map, buffer_channel_map);
+	else
+		channel_map_init_waveex(ch, 0, map);
+	for (i = 0; i < ch; i++)
+		vol[i] = channel_soft_vol(map[i], l, r);
+
+	frames = count / sf_get_frame_size(buffer_sf);
 	switch (bits) {
 	case 16:
-		SCALE_SAMPLES(int16_t, buffer, count, l, r, sf_need_swap(buffer_sf));
+		pcm_scale_s16(buffer, frames, ch, vol, sf_need_swap(buffer_sf));
 		break;
 	case 24:
 		if (likely(!sf_get_bigendian(buffer_sf)))
-			scale_samples_s24le(buffer, count, l, r);
+			pcm_scale_s24le(buffer, frames, ch, vol);
 		break;
 	case 32:
-		SCALE_SAMPLES(int32_t, buffer, count, l, r, sf_need_swap(buffer_sf));
+		pcm_scale_s32(buffer, frames, ch, vol, sf_need_swap(buffer_sf));
 		break;
 	}
 }
@@ -447,9 +396,11 @@ static inline void metadata_changed(void)
 
 	rc = ip_read_comments(ip, &comments);
 	if (!rc) {
-		if (player_info_priv.ti->comments)
-			keyvals_free(player_info_priv.ti->comments);
+		// the cache may be writing the comments out on another thread
+		cache_lock();
+		track_info_free_comments(player_info_priv.ti);
 		track_info_set_comments(player_info_priv.ti, comments);
+		cache_unlock();
 	}
 
 	player_info_priv.metadata_changed = 1;
@@ -616,7 +567,8 @@ static void _prebuffer(void)
 			metadata_changed();
 
 		/* buffer_fill with 0 count marks current chunk filled */
-		buffer_fill(nr_read);
+		if (buffer_fill(nr_read) || nr_read == 0)
+			pthread_cond_broadcast(&producer_playing);
 
 		_producer_buffer_fill_update();
 		if (nr_read == 0) {
@@ -816,8 +768,20 @@ static void _consumer_handle_eof(void)
 		return;
 	}
 
-	if (player_info_priv.ti)
-		player_info_priv.ti->play_count++;
+	if (player_info_priv.ti) {
+		ti = player_info_priv.ti;
+		ti->play_count++;
+		player_info_priv_lock();
+		if (!nr_played_tis || played_tis[nr_played_tis - 1] != ti) {
+			if (nr_played_tis == played_tis_alloc) {
+				played_tis_alloc = played_tis_alloc ? played_tis_alloc * 2 : 8;
+				played_tis = xrenew(struct track_info *, played_tis, played_tis_alloc);
+			}
+			track_info_ref(ti);
+			played_tis[nr_played_tis++] = ti;
+		}
+		player_info_priv_unlock();
+	}
 
 	if (player_repeat_current) {
 		if (player_cont) {
@@ -894,6 +858,10 @@ static void *consumer_loop(void *arg)
 		while (1) {
 			if (space == 0) {
 				_consumer_position_update();
+				if (op_wait(25) != -OP_ERROR_NOT_SUPPORTED) {
+					consumer_unlock();
+					break;
+				}
 				consumer_unlock();
 				ms_sleep(25);
 				break;
@@ -918,11 +886,12 @@ static void *consumer_loop(void *arg)
 						break;
 					} else {
 						/* possible underrun */
-						producer_unlock();
 						_consumer_position_update();
 						consumer_unlock();
 /* 						d_print("possible underrun\n"); */
-						ms_sleep(10);
+						/* the producer broadcasts when it has filled a chunk */
+						pthread_cond_wait(&producer_playing, &producer_mutex);
+						producer_unlock();
 						break;
 					}
 				}
@@ -947,7 +916,15 @@ static void *consumer_loop(void *arg)
 				consumer_unlock();
 				break;
 			}
-			buffer_consume(rc);
+			if (buffer_consume(rc)) {
+				/* pairs with the fence in _producer_wait_space() */
+				atomic_thread_fence(memory_order_seq_cst);
+				if (atomic_load(&producer_waiting)) {
+					producer_lock();
+					pthread_cond_broadcast(&producer_playing);
+					producer_unlock();
+				}
+			}
 			consumer_pos += rc;
 			space -= rc;
 		}
@@ -957,6 +934,19 @@ static void *consumer_loop(void *arg)
 	return NULL;
 }
 
+/* waits until the consumer frees a chunk or the status changes */
+static void _producer_wait_space(void)
+{
+	char *wpos;
+
+	atomic_store(&producer_waiting, true);
+	/* pairs with the fence in consumer_loop() */
+	atomic_thread_fence(memory_order_seq_cst);
+	if (buffer_get_wpos(&wpos) == 0)
+		pthread_cond_wait(&producer_playing, &producer_mutex);
+	atomic_store(&producer_waiting, false);
+}
+
 static void *producer_loop(void *arg)
 {
 	while (1) {
@@ -983,8 +973,8 @@ static void *producer_loop(void *arg)
 			size = buffer_get_wpos(&wpos);
 			if (size == 0) {
 				/* buffer is full */
+				_producer_wait_space();
 				producer_unlock();
-				ms_sleep(50);
 				break;
 			}
 			nr_read = ip_read(ip, wpos, size);
@@ -1004,11 +994,11 @@ static void *producer_loop(void *arg)
 				metadata_changed();
 
 			/* buffer_fill with 0 count marks current chunk filled */
-			buffer_fill(nr_read);
+			if (buffer_fill(nr_read) || nr_read == 0)
+				pthread_cond_broadcast(&producer_playing);
 			if (nr_read == 0) {
 				/* consumer handles EOF */
 				producer_unlock();
-				ms_sleep(50);
 				break;
 			}
 			if (i == chunks) {
@@ -1497,6 +1487,25 @@ void player_info_snapshot(void)
 	player_info_priv_unlock();
 }
 
+void player_save_play_counts(void)
+{
+	struct track_info **tis;
+	int i, nr;
+
+	player_info_priv_lock();
+	tis = played_tis;
+	nr = nr_played_tis;
+	played_tis = NULL;
+	nr_played_tis = played_tis_alloc = 0;
+	player_info_priv_unlock();
+
+	for (i = 0; i < nr; i++) {
+		cache_update_ti(tis[i]);
+		track_info_unref(tis[i]);
+	}
+	free(tis);
+}
+
 void player_metadata_lock(void)
 {
 	cmus_mutex_lock(&player_info_mutex);
@@ -106,6 +106,9 @@ void player_set_buffer_chunks(unsigned int nr_chunks);
 int player_get_buffer_chunks(void);
 void player_info_snapshot(void);
 
+/* journal play counts of tracks played to the end, called by the main thread */
+void player_save_play_counts(void);
+
 void player_set_soft_volume(int l, int r);
 void player_set_soft_vol(int soft);
 void player_set_rg(enum replaygain rg);
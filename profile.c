@@ -0,0 +1,93 @@
+/*
+ * Copyright 2026 Various Authors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "profile.h"
+#include "debug.h"
+#include "prog.h"
+#include "xmalloc.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define MAX_PHASES 64
+
+struct phase {
+	const char *name;
+	uint64_t usec;
+};
+
+static struct phase phases[MAX_PHASES];
+static int nr_phases;
+static uint64_t start_time;
+static char *profile_filename;
+
+void profile_init(const char *filename)
+{
+	start_time = profile_get();
+	if (filename)
+		profile_filename = xstrdup(filename);
+}
+
+uint64_t profile_get(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+void profile_phase(const char *name, uint64_t start)
+{
+	uint64_t usec = profile_get() - start;
+
+	timer_print(name, usec);
+	if (nr_phases == MAX_PHASES)
+		return;
+	phases[nr_phases].name = name;
+	phases[nr_phases].usec = usec;
+	nr_phases++;
+}
+
+void profile_total(const char *name)
+{
+	profile_phase(name, start_time);
+}
+
+void profile_exit(void)
+{
+	FILE *f;
+	int i;
+
+	if (!profile_filename)
+		return;
+
+	f = fopen(profile_filename, "w");
+	if (!f) {
+		warn_errno("opening `%s' for writing", profile_filename);
+		goto out;
+	}
+	fprintf(f, "version %s\n", VERSION);
+	for (i = 0; i < nr_phases; i++)
+		fprintf(f, "phase %s %llu\n", phases[i].name,
+				(unsigned long long)phases[i].usec);
+	if (fclose(f))
+		warn_errno("writing `%s'", profile_filename);
+out:
+	free(profile_filename);
+	profile_filename = NULL;
+}
@@ -0,0 +1,45 @@
+/*
+ * Copyright 2026 Various Authors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CMUS_PROFILE_H
+#define CMUS_PROFILE_H
+
+#include <stdint.h>
+
+/*
+ * Timing of the startup and shutdown phases.
+ *
+ * Every phase is printed to the debug log as it ends. If a file was given
+ * to profile_init() (--profile) the phases are also written there by
+ * profile_exit(), one "phase NAME USEC" line each, so that runs of
+ * different versions can be compared by scripts.
+ */
+
+/* @filename can be NULL */
+void profile_init(const char *filename);
+void profile_exit(void);
+
+/* monotonic time in microseconds, pass it to profile_phase() */
+uint64_t profile_get(void);
+
+/* @name must be a string literal */
+void profile_phase(const char *name, uint64_t start);
+
+/* time since profile_init() */
+void profile_total(const char *name);
+
+#endif
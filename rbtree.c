@@ -23,6 +23,11 @@
 
 #include "rbtree.h"
 
+static inline void _rb_update_size(struct rb_node *node)
+{
+	node->rb_size = rb_size(node->rb_left) + rb_size(node->rb_right) + 1;
+}
+
 static void _rb_rotate_left(struct rb_node *node, struct rb_root *root)
 {
 	struct rb_node *right = node->rb_right;
@@ -44,6 +49,9 @@ static void _rb_rotate_left(struct rb_node *node, struct rb_root *root)
 	else
 		root->rb_node = right;
 	rb_set_parent(node, right);
+
+	right->rb_size = node->rb_size;
+	_rb_update_size(node);
 }
 
 static void _rb_rotate_right(struct rb_node *node, struct rb_root *root)
@@ -67,12 +75,19 @@ static void _rb_rotate_right(struct rb_node *node, struct rb_root *root)
 	else
 		root->rb_node = left;
 	rb_set_parent(node, left);
+
+	left->rb_size = node->rb_size;
+	_rb_update_size(node);
 }
 
 void rb_insert_color(struct rb_node *node, struct rb_root *root)
 {
 	struct rb_node *parent, *gparent;
 
+	/* rb_link_node() doesn't know the ancestors' sizes yet */
+	for (parent = rb_parent(node); parent; parent = rb_parent(parent))
+		parent->rb_size++;
+
 	while ((parent = rb_parent(node)) && rb_is_red(parent))
 	{
 		gparent = rb_parent(parent);
@@ -277,6 +292,10 @@ void rb_erase(struct rb_node *node, struct rb_root *root)
 		root->rb_node = child;
 
  color:
+	/* every subtree that lost a node is on the way up from parent */
+	for (node = parent; node; node = rb_parent(node))
+		_rb_update_size(node);
+
 	if (color == RB_BLACK)
 		_rb_erase_color(child, parent, root);
 }
@@ -382,3 +401,88 @@ void rb_replace_node(struct rb_node *victim, struct rb_node *new,
 	/* Copy the pointers/colour from the victim to the replacement */
 	*new = *victim;
 }
+
+unsigned long rb_index(const struct rb_node *node)
+{
+	unsigned long index = rb_size(node->rb_left);
+	const struct rb_node *parent;
+
+	while ((parent = rb_parent(node))) {
+		if (node == parent->rb_right)
+			index += rb_size(parent->rb_left) + 1;
+		node = parent;
+	}
+	return index;
+}
+
+struct rb_node *rb_at(const struct rb_root *root, unsigned long index)
+{
+	struct rb_node *node = root->rb_node;
+
+	while (node) {
+		unsigned long left = rb_size(node->rb_left);
+
+		if (index < left) {
+			node = node->rb_left;
+		} else if (index == left) {
+			return node;
+		} else {
+			index -= left + 1;
+			node = node->rb_right;
+		}
+	}
+	return NULL;
+}
+
+void rb_insert_after(struct rb_node *node, struct rb_node *prev,
+		struct rb_root *root)
+{
+	struct rb_node **link, *parent = NULL;
+
+	if (prev) {
+		parent = prev;
+		link = &prev->rb_right;
+	} else {
+		link = &root->rb_node;
+	}
+	while (*link) {
+		parent = *link;
+		link = &parent->rb_left;
+	}
+	rb_link_node(node, parent, link);
+	rb_insert_color(node, root);
+}
+
+/*
+ * Halving keeps the sizes of sibling subtrees within one of each other, so
+ * levels 0 to @red_depth - 1 are full and black. Nodes on the last,
+ * partial level are red, which keeps the black height equal everywhere.
+ */
+static struct rb_node *build(struct rb_node **nodes, unsigned long nr,
+		struct rb_node *parent, int depth, int red_depth)
+{
+	unsigned long mid;
+	struct rb_node *node;
+
+	if (!nr)
+		return NULL;
+
+	mid = nr / 2;
+	node = nodes[mid];
+	node->rb_parent_color = (unsigned long)parent;
+	rb_set_color(node, depth == red_depth ? RB_RED : RB_BLACK);
+	node->rb_left = build(nodes, mid, node, depth + 1, red_depth);
+	node->rb_right = build(nodes + mid + 1, nr - mid - 1, node, depth + 1, red_depth);
+	node->rb_size = nr;
+	return node;
+}
+
+void rb_build(struct rb_root *root, struct rb_node **nodes, unsigned long nr)
+{
+	int red_depth = 0;
+
+	/* number of full levels */
+	while ((2UL << red_depth) - 1 <= nr)
+		red_depth++;
+	root->rb_node = build(nodes, nr, NULL, 0, red_depth);
+}
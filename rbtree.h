@@ -105,6 +105,8 @@ struct rb_node
 #define	RB_BLACK	1
 	struct rb_node *rb_right;
 	struct rb_node *rb_left;
+	/* number of nodes in this subtree, including this one */
+	unsigned long rb_size;
 } __attribute__((aligned(sizeof(long))));
 	/* The alignment might seem pointless, but allegedly CRIS needs it */
 
@@ -155,6 +157,7 @@ static inline void rb_link_node(struct rb_node * node, struct rb_node * parent,
 {
 	node->rb_parent_color = (unsigned long)parent;
 	node->rb_left = node->rb_right = NULL;
+	node->rb_size = 1;
 
 	*rb_link = node;
 }
@@ -162,6 +165,36 @@ static inline void rb_link_node(struct rb_node * node, struct rb_node * parent,
 
 /* Cmus extensions */
 
+/*
+ * Order statistics. Every node knows the size of its subtree, so the
+ * position of a node and the node at a position are found in O(log n).
+ * Positions start at 0.
+ */
+
+static inline unsigned long rb_size(const struct rb_node *node)
+{
+	return node ? node->rb_size : 0;
+}
+
+static inline unsigned long rb_count(const struct rb_root *root)
+{
+	return rb_size(root->rb_node);
+}
+
+unsigned long rb_index(const struct rb_node *node);
+/* NULL if @index >= rb_count(root) */
+struct rb_node *rb_at(const struct rb_root *root, unsigned long index);
+
+/* links @node right after @prev, or first if @prev is NULL, and rebalances */
+void rb_insert_after(struct rb_node *node, struct rb_node *prev,
+		struct rb_root *root);
+
+/*
+ * Replaces the contents of @root with a balanced tree of the @nr @nodes,
+ * in array order. O(n), nothing is compared.
+ */
+void rb_build(struct rb_root *root, struct rb_node **nodes, unsigned long nr);
+
 static inline void rb_root_init(struct rb_root *root)
 {
 	root->rb_node = NULL;
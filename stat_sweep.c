@@ -0,0 +1,182 @@
+/*
+ * Copyright 2026 Various Authors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "stat_sweep.h"
+#include "locking.h"
+#include "xmalloc.h"
+#include "utils.h"
+#include "debug.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+/* files of one directory are split into batches of at most this size */
+#define SWEEP_BATCH		256
+/* mostly waiting for the file system, not CPU bound */
+#define SWEEP_MAX_THREADS	8
+
+#ifndef O_PATH
+#define O_PATH O_RDONLY
+#endif
+
+struct sweep_item {
+	struct stat_sweep_entry *e;
+	/* length of the directory part including the last '/', 0 if none */
+	int dir_len;
+};
+
+struct sweep_batch {
+	int start;
+	int count;
+};
+
+struct sweep {
+	struct sweep_item *items;
+	struct sweep_batch *batches;
+	int nr_batches;
+	/* next batch to process */
+	int next;
+	pthread_mutex_t mutex;
+};
+
+static int item_cmp(const void *a, const void *b)
+{
+	const struct sweep_item *ia = a;
+	const struct sweep_item *ib = b;
+	int len = min_i(ia->dir_len, ib->dir_len);
+	int rc;
+
+	// by directory first, subdirectories must not split a directory
+	rc = memcmp(ia->e->filename, ib->e->filename, len);
+	if (rc || ia->dir_len != ib->dir_len)
+		return rc ? rc : ia->dir_len - ib->dir_len;
+	return strcmp(ia->e->filename + len, ib->e->filename + len);
+}
+
+static void set_result(struct stat_sweep_entry *e, int rc, const struct stat *st)
+{
+	if (rc) {
+		e->err = errno;
+		e->mtime = 0;
+	} else {
+		e->err = 0;
+		e->mtime = st->st_mtime;
+	}
+}
+
+static void sweep_batch(struct sweep_item *items, int count)
+{
+	int i, dirfd = -1, dir_len = items[0].dir_len;
+	struct stat st;
+
+	if (dir_len) {
+		char *dir = xstrndup(items[0].e->filename, dir_len);
+
+		dirfd = open(dir, O_PATH | O_DIRECTORY | O_CLOEXEC);
+		free(dir);
+	}
+
+	for (i = 0; i < count; i++) {
+		struct stat_sweep_entry *e = items[i].e;
+		int rc;
+
+		if (dirfd >= 0)
+			rc = fstatat(dirfd, e->filename + dir_len, &st, 0);
+		else
+			rc = stat(e->filename, &st);
+		set_result(e, rc, &st);
+	}
+
+	if (dirfd >= 0)
+		close(dirfd);
+}
+
+static void *sweep_thread(void *data)
+{
+	struct sweep *s = data;
+
+	while (1) {
+		struct sweep_batch *b;
+
+		cmus_mutex_lock(&s->mutex);
+		b = s->next < s->nr_batches ? &s->batches[s->next++] : NULL;
+		cmus_mutex_unlock(&s->mutex);
+		if (!b)
+			break;
+		sweep_batch(s->items + b->start, b->count);
+	}
+	return NULL;
+}
+
+void stat_sweep(struct stat_sweep_entry *entries, int count)
+{
+	pthread_t threads[SWEEP_MAX_THREADS];
+	struct sweep s = {};
+	int i, nr_threads, started = 0;
+	uint64_t t = timer_get();
+
+	if (!count)
+		return;
+
+	s.items = xnew(struct sweep_item, count);
+	for (i = 0; i < count; i++) {
+		const char *slash = strrchr(entries[i].filename, '/');
+
+		s.items[i].e = &entries[i];
+		s.items[i].dir_len = slash ? slash - entries[i].filename + 1 : 0;
+	}
+	qsort(s.items, count, sizeof(*s.items), item_cmp);
+
+	s.batches = xnew(struct sweep_batch, count);
+	for (i = 0; i < count; ) {
+		struct sweep_batch *b = &s.batches[s.nr_batches++];
+		const char *dir = s.items[i].e->filename;
+		int dir_len = s.items[i].dir_len;
+
+		b->start = i;
+		b->count = 0;
+		while (i < count && b->count < SWEEP_BATCH &&
+				s.items[i].dir_len == dir_len &&
+				!memcmp(s.items[i].e->filename, dir, dir_len)) {
+			b->count++;
+			i++;
+		}
+	}
+
+	pthread_mutex_init(&s.mutex, NULL);
+	nr_threads = min_i(SWEEP_MAX_THREADS, s.nr_batches);
+	for (i = 1; i < nr_threads; i++) {
+		if (pthread_create(&threads[started], NULL, sweep_thread, &s))
+			break;
+		started++;
+	}
+	// the calling thread helps
+	sweep_thread(&s);
+	for (i = 0; i < started; i++)
+		pthread_join(threads[i], NULL);
+	pthread_mutex_destroy(&s.mutex);
+
+	timer_print("stat sweep", timer_get() - t);
+	d_print("%d files in %d batches on %d threads\n", count, s.nr_batches, started + 1);
+	free(s.batches);
+	free(s.items);
+}
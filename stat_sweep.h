@@ -0,0 +1,39 @@
+/*
+ * Copyright 2026 Various Authors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CMUS_STAT_SWEEP_H
+#define CMUS_STAT_SWEEP_H
+
+#include <time.h>
+
+struct stat_sweep_entry {
+	const char *filename;
+
+	/* results: 0 or errno of stat(), and st_mtime if successful */
+	int err;
+	time_t mtime;
+};
+
+/*
+ * stat()s all entries. Files are grouped by directory and looked up with
+ * fstatat() relative to the directory, several directories at a time on
+ * different threads so that slow (network) file systems don't serialize
+ * everything.
+ */
+void stat_sweep(struct stat_sweep_entry *entries, int count);
+
+#endif
@@ -0,0 +1,349 @@
+/*
+ * Copyright 2026 Various Authors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "text_index.h"
+#include "uchar.h"
+#include "misc.h"
+#include "utils.h"
+#include "xmalloc.h"
+#include "debug.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Every track gets an id when it is added. Ids are only handed out in
+ * increasing order, so the id lists of the trigrams stay sorted and can be
+ * intersected by merging. Removed tracks leave holes in docs[] that are
+ * skipped by lookups until enough of them have piled up to renumber
+ * everything.
+ */
+
+#define COMPACT_MIN_REMOVED	1024
+
+/* three 21 bit characters */
+#define TRIGRAM_CHAR_MASK	0x1fffffU
+
+struct doc {
+	struct track_info *ti;
+	uint32_t id;
+};
+
+struct posting {
+	uint64_t key;
+	uint32_t *ids;
+	uint32_t nr;
+	uint32_t alloc;
+};
+
+/* struct doc by hash_ptr(ti) */
+static struct hashtable doc_table = HASHTABLE_INIT;
+/* struct posting by hash_u64(key) */
+static struct hashtable posting_table = HASHTABLE_INIT;
+
+/* by id, NULL if removed */
+static struct doc **docs;
+static uint32_t nr_docs;
+static uint32_t alloc_docs;
+static uint32_t nr_removed;
+
+/* tracks without any of the fields, track_info_matches() checks the filename */
+static struct posting untagged;
+
+static bool doc_ti_eq(const void *ptr, const void *key)
+{
+	const struct doc *doc = ptr;
+
+	return doc->ti == key;
+}
+
+static bool posting_key_eq(const void *ptr, const void *key)
+{
+	const struct posting *p = ptr;
+
+	return p->key == *(const uint64_t *)key;
+}
+
+static uchar *fold_text(const char *str, int *count)
+{
+	uchar *chars = xnew(uchar, strlen(str) + 1);
+	int idx = 0, n = 0;
+
+	while (str[idx])
+		chars[n++] = u_casefold_base_char(u_get_char(str, &idx));
+	*count = n;
+	return chars;
+}
+
+static inline uint64_t trigram_key(const uchar *c)
+{
+	return ((uint64_t)(c[0] & TRIGRAM_CHAR_MASK) << 42) |
+		((uint64_t)(c[1] & TRIGRAM_CHAR_MASK) << 21) |
+		(c[2] & TRIGRAM_CHAR_MASK);
+}
+
+static struct posting *find_posting(uint64_t key)
+{
+	return hashtable_find(&posting_table, hash_u64(key), posting_key_eq, &key);
+}
+
+static void posting_add(struct posting *p, uint32_t id)
+{
+	if (p->nr == p->alloc) {
+		p->alloc = p->alloc ? p->alloc * 2 : 4;
+		p->ids = xrenew(uint32_t, p->ids, p->alloc);
+	}
+	p->ids[p->nr++] = id;
+}
+
+static void posting_free(struct posting *p)
+{
+	free(p->ids);
+	free(p);
+}
+
+static void posting_compact(struct posting *p, const uint32_t *map)
+{
+	uint32_t i, n = 0;
+
+	for (i = 0; i < p->nr; i++) {
+		if (map[p->ids[i]] != UINT32_MAX)
+			p->ids[n++] = map[p->ids[i]];
+	}
+	p->nr = n;
+}
+
+static int key_cmp(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a;
+	uint64_t y = *(const uint64_t *)b;
+
+	return (x > y) - (x < y);
+}
+
+static void compact(void)
+{
+	uint32_t *map = xnew(uint32_t, nr_docs);
+	struct hashtable_iter iter;
+	struct posting *p, **empty;
+	uint32_t i, n = 0, nr_empty = 0;
+
+	for (i = 0; i < nr_docs; i++) {
+		if (docs[i]) {
+			map[i] = n;
+			docs[i]->id = n;
+			docs[n++] = docs[i];
+		} else {
+			map[i] = UINT32_MAX;
+		}
+	}
+
+	empty = xnew(struct posting *, hashtable_count(&posting_table));
+	hashtable_iter_init(&iter, &posting_table);
+	while ((p = hashtable_iter_next(&iter))) {
+		posting_compact(p, map);
+		if (!p->nr)
+			empty[nr_empty++] = p;
+	}
+	for (i = 0; i < nr_empty; i++) {
+		hashtable_remove(&posting_table, hash_u64(empty[i]->key), empty[i]);
+		posting_free(empty[i]);
+	}
+	posting_compact(&untagged, map);
+
+	d_print("%u tracks, %u removed\n", n, nr_docs - n);
+	nr_docs = n;
+	nr_removed = 0;
+	free(empty);
+	free(map);
+}
+
+void text_index_add(struct track_info *ti)
+{
+	const char *fields[] = { ti->artist, ti->album, ti->title, ti->albumartist };
+	uint64_t *keys = NULL;
+	size_t nr_keys = 0, alloc_keys = 0;
+	struct doc *doc;
+	bool tagged = false;
+	size_t i, n;
+
+	doc = xnew(struct doc, 1);
+	doc->ti = ti;
+	doc->id = nr_docs;
+	if (nr_docs == alloc_docs) {
+		alloc_docs = alloc_docs ? alloc_docs * 2 : 1024;
+		docs = xrenew(struct doc *, docs, alloc_docs);
+	}
+	docs[nr_docs++] = doc;
+	hashtable_insert(&doc_table, hash_ptr(ti), doc);
+
+	for (i = 0; i < N_ELEMENTS(fields); i++) {
+		uchar *chars;
+		int j, count;
+
+		if (!fields[i])
+			continue;
+		tagged = true;
+
+		chars = fold_text(fields[i], &count);
+		if (nr_keys + count > alloc_keys) {
+			alloc_keys = nr_keys + count;
+			keys = xrenew(uint64_t, keys, alloc_keys);
+		}
+		for (j = 0; j + 3 <= count; j++)
+			keys[nr_keys++] = trigram_key(chars + j);
+		free(chars);
+	}
+
+	if (!tagged) {
+		posting_add(&untagged, doc->id);
+		return;
+	}
+
+	qsort(keys, nr_keys, sizeof(keys[0]), key_cmp);
+	for (i = 0, n = 0; i < nr_keys; i++) {
+		struct posting *p;
+
+		if (n && keys[i] == keys[n - 1])
+			continue;
+		keys[n++] = keys[i];
+
+		p = find_posting(keys[i]);
+		if (!p) {
+			p = xnew0(struct posting, 1);
+			p->key = keys[i];
+			hashtable_insert(&posting_table, hash_u64(p->key), p);
+		}
+		posting_add(p, doc->id);
+	}
+	free(keys);
+}
+
+void text_index_remove(struct track_info *ti)
+{
+	uint32_t hash = hash_ptr(ti);
+	struct doc *doc;
+
+	doc = hashtable_find(&doc_table, hash, doc_ti_eq, ti);
+	if (!doc)
+		return;
+
+	hashtable_remove(&doc_table, hash, doc);
+	docs[doc->id] = NULL;
+	free(doc);
+
+	nr_removed++;
+	if (nr_removed >= COMPACT_MIN_REMOVED && nr_removed > nr_docs / 2)
+		compact();
+}
+
+void text_index_clear(void)
+{
+	struct hashtable_iter iter;
+	struct posting *p;
+	uint32_t i;
+
+	hashtable_iter_init(&iter, &posting_table);
+	while ((p = hashtable_iter_next(&iter)))
+		posting_free(p);
+	hashtable_clear(&posting_table);
+	hashtable_clear(&doc_table);
+
+	for (i = 0; i < nr_docs; i++)
+		free(docs[i]);
+	free(docs);
+	docs = NULL;
+	nr_docs = alloc_docs = nr_removed = 0;
+
+	free(untagged.ids);
+	memset(&untagged, 0, sizeof(untagged));
+}
+
+/* intersects sorted id lists, result is stored to @a */
+static uint32_t intersect(uint32_t *a, uint32_t nr_a, const uint32_t *b, uint32_t nr_b)
+{
+	uint32_t i = 0, j = 0, n = 0;
+
+	while (i < nr_a && j < nr_b) {
+		if (a[i] < b[j]) {
+			i++;
+		} else if (a[i] > b[j]) {
+			j++;
+		} else {
+			a[n++] = a[i];
+			i++;
+			j++;
+		}
+	}
+	return n;
+}
+
+static void add_result(struct hashtable *result, const uint32_t *ids, uint32_t nr)
+{
+	uint32_t i;
+
+	for (i = 0; i < nr; i++) {
+		struct doc *doc = docs[ids[i]];
+
+		if (doc)
+			hashtable_insert(result, hash_ptr(doc->ti), doc->ti);
+	}
+}
+
+bool text_index_lookup(const char *text, struct hashtable *result)
+{
+	char **words = get_words(text);
+	uint32_t *cand = NULL;
+	uint32_t nr_cand = 0;
+	bool narrowed = false;
+	int i;
+
+	for (i = 0; words[i]; i++) {
+		uchar *chars;
+		int j, count;
+
+		chars = fold_text(words[i], &count);
+		for (j = 0; j + 3 <= count; j++) {
+			struct posting *p = find_posting(trigram_key(chars + j));
+
+			if (!p) {
+				nr_cand = 0;
+			} else if (!narrowed) {
+				cand = xnew(uint32_t, p->nr);
+				memcpy(cand, p->ids, p->nr * sizeof(cand[0]));
+				nr_cand = p->nr;
+			} else {
+				nr_cand = intersect(cand, nr_cand, p->ids, p->nr);
+			}
+			narrowed = true;
+			if (!nr_cand)
+				break;
+		}
+		free(chars);
+		if (narrowed && !nr_cand)
+			break;
+	}
+	free_str_array(words);
+
+	if (!narrowed)
+		return false;
+
+	add_result(result, cand, nr_cand);
+	add_result(result, untagged.ids, untagged.nr);
+	free(cand);
+	return true;
+}
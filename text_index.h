@@ -0,0 +1,52 @@
+/*
+ * Copyright 2026 Various Authors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CMUS_TEXT_INDEX_H
+#define CMUS_TEXT_INDEX_H
+
+#include "track_info.h"
+#include "hashtable.h"
+
+#include <stdbool.h>
+
+/*
+ * Trigram index of the artist, album, title and albumartist of tracks.
+ *
+ * Characters are compared like u_strcasestr_base() does, so every track
+ * for which track_info_matches(ti, text, TI_MATCH_ALL) is true contains
+ * all trigrams of every word of text. The opposite is not true: lookups
+ * return candidates that still have to be checked with
+ * track_info_matches().
+ *
+ * Tracks are not referenced, they must be removed before they are freed.
+ * Only used by the main thread.
+ */
+
+void text_index_add(struct track_info *ti);
+void text_index_remove(struct track_info *ti);
+void text_index_clear(void);
+
+/*
+ * Inserts all tracks that can match @text into @result, hashed with
+ * hash_ptr().
+ *
+ * Returns false and leaves @result empty if @text has no word with three
+ * or more characters. Every track can match then.
+ */
+bool text_index_lookup(const char *text, struct hashtable *result);
+
+#endif
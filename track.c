@@ -23,19 +23,52 @@
 #include "window.h"
 #include "options.h"
 #include "uchar.h"
+#include "u_collate.h"
 #include "xmalloc.h"
 #include "debug.h"
 #include "misc.h"
+#include "utils.h"
+#include "gbuf.h"
+#include "parallel.h"
 
 #include <string.h>
 
 void simple_track_init(struct simple_track *track, struct track_info *ti)
 {
 	track->info = ti;
+	track->info_next = ti->tracks;
+	ti->tracks = track;
+	track->sort_key = NULL;
+	track->sort_key_len = 0;
+	track->sort_key_gen = 0;
 	track->marked = 0;
 	RB_CLEAR_NODE(&track->tree_node);
 }
 
+void simple_track_unlink(struct simple_track *track)
+{
+	struct simple_track **p = &track->info->tracks;
+
+	/* usually the only one */
+	while (*p != track)
+		p = &(*p)->info_next;
+	*p = track->info_next;
+	track->info_next = NULL;
+}
+
+void simple_track_set_info(struct simple_track *track, struct track_info *ti)
+{
+	struct track_info *old = track->info;
+
+	simple_track_unlink(track);
+	track_info_ref(ti);
+	track->info = ti;
+	track->info_next = ti->tracks;
+	ti->tracks = track;
+	simple_track_clear_sort_key(track);
+	track_info_unref(old);
+}
+
 struct simple_track *simple_track_new(struct track_info *ti)
 {
 	struct simple_track *t = xnew(struct simple_track, 1);
@@ -80,16 +113,7 @@ void shuffle_insert(struct rb_root *root, struct shuffle_info *previous, struct
 	if (previous == next)
 		return;
 	rb_erase(&next->tree_node, root);
-
-	struct rb_node *parent = previous ? &previous->tree_node : NULL;
-	struct rb_node **new = parent ? &parent->rb_right : &root->rb_node;
-	while (*new) {
-		parent = *new;
-		new = &(*new)->rb_left;
-	}
-
-	rb_link_node(&next->tree_node, parent, new);
-	rb_insert_color(&next->tree_node, root);
+	rb_insert_after(&next->tree_node, previous ? &previous->tree_node : NULL, root);
 }
 
 struct shuffle_info *shuffle_list_get_next(struct rb_root *root, struct shuffle_info *cur,
@@ -202,116 +226,374 @@ again:
 	return NULL;
 }
 
+unsigned int sort_keys_gen_new(void)
+{
+	static unsigned int gen;
+
+	/* 0 is never current */
+	if (++gen == 0)
+		gen++;
+	return gen;
+}
+
+void simple_track_clear_sort_key(struct simple_track *track)
+{
+	free(track->sort_key);
+	track->sort_key = NULL;
+	track->sort_key_len = 0;
+	track->sort_key_gen = 0;
+}
+
+/* @buf is scratch space */
+static void update_sort_key(struct simple_track *track, const sort_key_t *keys,
+		unsigned int keys_gen, int strcoll_is_strcmp, struct gbuf *buf)
+{
+	if (track->sort_key_gen == keys_gen)
+		return;
+
+	gbuf_clear(buf);
+	track_info_sort_key(track->info, keys, strcoll_is_strcmp, buf);
+	track->sort_key = xrenew(char, track->sort_key, buf->len + 1);
+	memcpy(track->sort_key, buf->buffer, buf->len);
+	track->sort_key_len = buf->len;
+	track->sort_key_gen = keys_gen;
+}
+
+static int key_cmp(const char *a, unsigned int a_len, const char *b, unsigned int b_len)
+{
+	int res = memcmp(a, b, min_u(a_len, b_len));
+
+	if (res)
+		return res;
+	return (a_len > b_len) - (a_len < b_len);
+}
+
+static int sort_key_cmp(const struct simple_track *a, const struct simple_track *b)
+{
+	return key_cmp(a->sort_key, a->sort_key_len, b->sort_key, b->sort_key_len);
+}
+
 void sorted_list_add_track(struct list_head *head, struct rb_root *tree_root, struct simple_track *track,
-		const sort_key_t *keys, int tiebreak)
+		const sort_key_t *keys, unsigned int keys_gen, int tiebreak)
 {
-	struct rb_node **new = &(tree_root->rb_node), *parent = NULL, *curr, *next;
+	struct rb_node **new = &(tree_root->rb_node), *parent = NULL, *next;
 	struct list_head *node;
-	int result = 0;
-
-	/* try to locate track in tree */
+	int sorted = keys[0] != SORT_INVALID;
+	int strcoll_is_strcmp = sorted && u_strcoll_is_strcmp();
+	static GBUF(buf);
+
+	if (sorted)
+		update_sort_key(track, keys, keys_gen, strcoll_is_strcmp, &buf);
+
+	/*
+	 * every track is in the tree, in list order, so that its row in the
+	 * list is its index in the tree. equal tracks keep the order they were
+	 * added in, unless @tiebreak < 0 puts the new one before them.
+	 */
 	while (*new) {
-		const struct simple_track *t = tree_node_to_simple_track(*new);
-		result = track_info_cmp(track->info, t->info, keys);
+		struct simple_track *t = tree_node_to_simple_track(*new);
+		int result = 0;
+
+		if (sorted) {
+			update_sort_key(t, keys, keys_gen, strcoll_is_strcmp, &buf);
+			result = sort_key_cmp(track, t);
+		}
 
 		parent = *new;
-		if (result < 0)
+		if (result < 0 || (result == 0 && tiebreak < 0))
 			new = &(parent->rb_left);
-		else if (result > 0)
-			new = &(parent->rb_right);
 		else
-			break;
+			new = &(parent->rb_right);
 	}
+	rb_link_node(&track->tree_node, parent, new);
+	rb_insert_color(&track->tree_node, tree_root);
 
-	/* duplicate is present in the tree */
-	if (parent && result == 0) {
-		if (tiebreak < 0) {
-			node = &(tree_node_to_simple_track(parent)->node);
-			rb_replace_node(parent, &track->tree_node, tree_root);
-			RB_CLEAR_NODE(parent);
-		} else {
-			next = rb_next(parent);
-			node = next ? &(tree_node_to_simple_track(next)->node) : head;
-		}
-	} else {
-		rb_link_node(&track->tree_node, parent, new);
-		curr = *new;
-		rb_insert_color(&track->tree_node, tree_root);
-		if (result < 0) {
-			node = &(tree_node_to_simple_track(parent)->node);
-		} else if (result > 0) {
-			next = rb_next(curr);
-			node = next ? &(tree_node_to_simple_track(next)->node) : head;
-		} else {
-			/* rbtree was empty, just add after list head */
-			node = head;
-		}
-	}
+	next = rb_next(&track->tree_node);
+	node = next ? &(tree_node_to_simple_track(next)->node) : head;
 	list_add(&track->node, node->prev);
 }
 
 void sorted_list_remove_track(struct list_head *head, struct rb_root *tree_root, struct simple_track *track)
 {
-	struct simple_track *next_track;
-	struct rb_node *tree_next;
+	rb_erase(&track->tree_node, tree_root);
+	list_del(&track->node);
+	simple_track_clear_sort_key(track);
+}
+
+/* buckets smaller than this are insertion sorted */
+#define RADIX_SORT_MIN	32
+
+/* sort key copied next to the track, saves a pointer chase per look */
+struct sort_item {
+	const char *key;
+	unsigned int len;
+	struct simple_track *track;
+};
+
+static int item_cmp(const struct sort_item *a, const struct sort_item *b)
+{
+	return key_cmp(a->key, a->len, b->key, b->len);
+}
+
+/* 0 if the key ends before @depth */
+static inline unsigned int radix_byte(const struct sort_item *item, unsigned int depth)
+{
+	if (depth >= item->len)
+		return 0;
+	return (unsigned char)item->key[depth] + 1;
+}
+
+/* @depth, or how far beyond it all keys are equal */
+static unsigned int common_prefix(const struct sort_item *items, size_t n, unsigned int depth)
+{
+	const char *first = items[0].key;
+	unsigned int len = items[0].len;
+	size_t i;
 
-	if (!RB_EMPTY_NODE(&track->tree_node)) {
-		next_track = (track->node.next != head) ? to_simple_track(track->node.next) : NULL;
-		tree_next = rb_next(&track->tree_node);
+	for (i = 1; i < n && len > depth; i++) {
+		unsigned int j = depth;
 
-		if (next_track && (!tree_next || tree_node_to_simple_track(tree_next) != next_track)) {
-			rb_replace_node(&track->tree_node, &next_track->tree_node, tree_root);
-			RB_CLEAR_NODE(&track->tree_node);
-		} else
-			rb_erase(&track->tree_node, tree_root);
+		len = min_u(len, items[i].len);
+		while (j < len && items[i].key[j] == first[j])
+			j++;
+		len = j;
 	}
-	list_del(&track->node);
+	return len;
 }
 
-void rand_list_rebuild(struct list_head *head, struct rb_root *tree_root)
+/* stable MSD radix sort, @tmp has room for @n items */
+static void radix_sort(struct sort_item *items, struct sort_item *tmp,
+		size_t n, unsigned int depth)
 {
-	struct list_head *item, *tmp;
-	struct rb_root tmp_tree = RB_ROOT;
-	struct simple_track **track_array;
-	static const sort_key_t empty_sort_keys[] = { SORT_INVALID };
+	size_t end[257];
+	size_t i, start;
+	unsigned int b;
+
+	while (n >= RADIX_SORT_MIN) {
+		/* equal keys would otherwise be counted again for every byte */
+		depth = common_prefix(items, n, depth);
 
-	unsigned int len = 0, track_cnt = 0;
+		memset(end, 0, sizeof(end));
+		for (i = 0; i < n; i++)
+			end[radix_byte(&items[i], depth)]++;
 
-	list_for_each(item, head) {
-		len++;
+		/* all keys have ended and are equal, or nothing to split */
+		if (end[0] == n)
+			return;
+		if (end[radix_byte(&items[0], depth)] == n) {
+			depth++;
+			continue;
+		}
+
+		/* counts to bucket starts, scattering moves them to the ends */
+		for (b = 0, start = 0; b < 257; b++) {
+			size_t count = end[b];
+
+			end[b] = start;
+			start += count;
+		}
+		for (i = 0; i < n; i++)
+			tmp[end[radix_byte(&items[i], depth)]++] = items[i];
+		memcpy(items, tmp, n * sizeof(items[0]));
+
+		for (b = 1; b < 257; b++) {
+			start = end[b - 1];
+			if (end[b] - start > 1)
+				radix_sort(items + start, tmp, end[b] - start, depth + 1);
+		}
+		return;
 	}
-	track_array = xmalloc(len * sizeof(track_array[0]));
 
-	LIST_HEAD(tmp_head);
-	list_for_each_safe(item, tmp, head) {
-		struct simple_track *track = to_simple_track(item);
-		sorted_list_remove_track(head, tree_root, track);
-		track_array[track_cnt] = track;
-		track_cnt++;
+	for (i = 1; i < n; i++) {
+		struct sort_item item = items[i];
+		size_t j = i;
+
+		while (j > 0 && item_cmp(&items[j - 1], &item) > 0) {
+			items[j] = items[j - 1];
+			j--;
+		}
+		items[j] = item;
 	}
-	shuffle_array(track_array, len, sizeof(track_array[0]));
-	for (unsigned int i=0; i<len; i++) {
-		sorted_list_add_track(&tmp_head, &tmp_tree, track_array[i], empty_sort_keys, 0);
+}
+
+struct sort_runs {
+	struct sort_item *items;
+	struct sort_item *tmp;
+	/* run_end[start] of every sorted run */
+	int *run_end;
+	const sort_key_t *keys;
+	unsigned int keys_gen;
+	int strcoll_is_strcmp;
+};
+
+static void sort_run(void *data, int start, int end)
+{
+	struct sort_runs *s = data;
+	GBUF(buf);
+	int i;
+
+	for (i = start; i < end; i++) {
+		struct simple_track *track = s->items[i].track;
+
+		update_sort_key(track, s->keys, s->keys_gen, s->strcoll_is_strcmp, &buf);
+		s->items[i].key = track->sort_key;
+		s->items[i].len = track->sort_key_len;
 	}
-	free(track_array);
+	gbuf_free(&buf);
 
-	tree_root->rb_node = tmp_tree.rb_node;
-	_list_add(head, tmp_head.prev, tmp_head.next);
+	radix_sort(s->items + start, s->tmp + start, end - start, 0);
+	s->run_end[start] = end;
 }
 
-void sorted_list_rebuild(struct list_head *head, struct rb_root *tree_root, const sort_key_t *keys)
+/* stable, items of @a come first if equal */
+static void merge_runs(struct sort_item *dst, const struct sort_item *a, int nr_a,
+		const struct sort_item *b, int nr_b)
 {
-	struct list_head *item, *tmp;
-	struct rb_root tmp_tree = RB_ROOT;
-	LIST_HEAD(tmp_head);
+	int i = 0, j = 0, n = 0;
 
-	list_for_each_safe(item, tmp, head) {
-		struct simple_track *track = to_simple_track(item);
-		sorted_list_remove_track(head, tree_root, track);
-		sorted_list_add_track(&tmp_head, &tmp_tree, track, keys, 0);
+	while (i < nr_a && j < nr_b) {
+		if (item_cmp(&b[j], &a[i]) < 0)
+			dst[n++] = b[j++];
+		else
+			dst[n++] = a[i++];
 	}
-	tree_root->rb_node = tmp_tree.rb_node;
-	_list_add(head, tmp_head.prev, tmp_head.next);
+	while (i < nr_a)
+		dst[n++] = a[i++];
+	while (j < nr_b)
+		dst[n++] = b[j++];
+}
+
+/*
+ * Sorts runs of @items on all CPUs and merges them pairwise. Returns
+ * @items or @tmp, whichever holds the result.
+ */
+static struct sort_item *sort_items(struct sort_item *items, struct sort_item *tmp,
+		int n, const sort_key_t *keys, unsigned int keys_gen)
+{
+	struct sort_runs s = {
+		.items = items,
+		.tmp = tmp,
+		.run_end = xnew(int, n),
+		.keys = keys,
+		.keys_gen = keys_gen,
+		/* setlocale() is not called on the workers */
+		.strcoll_is_strcmp = u_strcoll_is_strcmp(),
+	};
+	int nr_runs = 0;
+	int i;
+
+	parallel_for(n, sort_run, &s);
+
+	/* run_end[i] is now the end of the i:th run, for i < nr_runs */
+	for (i = 0; i < n; i = s.run_end[i])
+		s.run_end[nr_runs++] = s.run_end[i];
+
+	while (nr_runs > 1) {
+		struct sort_item *swap;
+		int start = 0, nr = 0;
+
+		for (i = 0; i < nr_runs; i += 2) {
+			int mid = s.run_end[i];
+			int end = i + 1 < nr_runs ? s.run_end[i + 1] : mid;
+
+			merge_runs(tmp + start, items + start, mid - start, items + mid, end - mid);
+			s.run_end[nr++] = end;
+			start = end;
+		}
+		nr_runs = nr;
+
+		swap = items;
+		items = tmp;
+		tmp = swap;
+	}
+	free(s.run_end);
+	return items;
+}
+
+/* replaces the list and tree with @tracks, in array order */
+static void relink_tracks(struct list_head *head, struct rb_root *tree_root,
+		struct simple_track **tracks, int n)
+{
+	struct rb_node **nodes = xnew(struct rb_node *, n);
+	int i;
+
+	list_init(head);
+	for (i = 0; i < n; i++) {
+		list_add_tail(&tracks[i]->node, head);
+		nodes[i] = &tracks[i]->tree_node;
+	}
+	rb_build(tree_root, nodes, n);
+	free(nodes);
+}
+
+/* sorts @tracks stably and makes them the list and tree */
+static void sort_and_relink(struct list_head *head, struct rb_root *tree_root,
+		struct simple_track **tracks, int n, const sort_key_t *keys,
+		unsigned int keys_gen)
+{
+	struct sort_item *items, *tmp, *sorted;
+	int i;
+
+	if (keys[0] != SORT_INVALID && n > 1) {
+		items = xnew(struct sort_item, n);
+		for (i = 0; i < n; i++)
+			items[i].track = tracks[i];
+		tmp = xnew(struct sort_item, n);
+		sorted = sort_items(items, tmp, n, keys, keys_gen);
+		for (i = 0; i < n; i++)
+			tracks[i] = sorted[i].track;
+		free(items);
+		free(tmp);
+	}
+	relink_tracks(head, tree_root, tracks, n);
+}
+
+void sorted_list_rebuild(struct list_head *head, struct rb_root *tree_root, const sort_key_t *keys,
+		unsigned int keys_gen)
+{
+	struct simple_track **tracks;
+	struct list_head *item;
+	int i = 0, n = list_len(head);
+
+	if (keys[0] == SORT_INVALID || n == 0)
+		return;
+
+	tracks = xnew(struct simple_track *, n);
+	list_for_each(item, head)
+		tracks[i++] = to_simple_track(item);
+	sort_and_relink(head, tree_root, tracks, n, keys, keys_gen);
+	free(tracks);
+}
+
+void sorted_list_add_tracks(struct list_head *head, struct rb_root *tree_root,
+		struct simple_track **new_tracks, int nr, const sort_key_t *keys,
+		unsigned int keys_gen)
+{
+	struct simple_track **tracks;
+	struct list_head *item;
+	int i = 0, n = rb_count(tree_root);
+
+	/* the old tracks are sorted already, a stable sort keeps them before equal new ones */
+	tracks = xnew(struct simple_track *, n + nr);
+	list_for_each(item, head)
+		tracks[i++] = to_simple_track(item);
+	memcpy(tracks + n, new_tracks, nr * sizeof(tracks[0]));
+	sort_and_relink(head, tree_root, tracks, n + nr, keys, keys_gen);
+	free(tracks);
+}
+
+void rand_list_rebuild(struct list_head *head, struct rb_root *tree_root)
+{
+	struct simple_track **tracks;
+	struct list_head *item;
+	int i = 0, n = list_len(head);
+
+	tracks = xnew(struct simple_track *, n);
+	list_for_each(item, head)
+		tracks[i++] = to_simple_track(item);
+	shuffle_array(tracks, n, sizeof(tracks[0]));
+	relink_tracks(head, tree_root, tracks, n);
+	free(tracks);
 }
 
 static int compare_rand(const struct rb_node *a, const struct rb_node *b)
@@ -359,19 +641,57 @@ void shuffle_list_add(struct shuffle_info *track, struct rb_root *tree_root, str
 	rb_insert_color(&track->tree_node, tree_root);
 }
 
-void shuffle_list_reshuffle(struct rb_root *tree_root)
+static int shuffle_info_cmp(const void *a, const void *b)
 {
-	struct rb_node *node, *tmp;
-	struct rb_root tmptree = RB_ROOT;
+	const struct shuffle_info *x = *(struct shuffle_info * const *)a;
+	const struct shuffle_info *y = *(struct shuffle_info * const *)b;
 
-	rb_for_each_safe(node, tmp, tree_root) {
-		struct shuffle_info *track = tree_node_to_shuffle_info(node);
-		struct album *album = track->album;
-		rb_erase(node, tree_root);
-		shuffle_list_add(track, &tmptree, album);
+	return compare_rand(&x->tree_node, &y->tree_node);
+}
+
+void shuffle_list_add_many(struct shuffle_info **infos, int nr, struct rb_root *tree_root)
+{
+	struct rb_node **nodes, *node;
+	int i, j, k, n = rb_count(tree_root);
+
+	/* not worth touching the whole tree */
+	if (nr < n / 8) {
+		for (i = 0; i < nr; i++)
+			shuffle_list_add(infos[i], tree_root, infos[i]->album);
+		return;
 	}
 
-	tree_root->rb_node = tmptree.rb_node;
+	for (i = 0; i < nr; i++)
+		shuffle_info_init(infos[i], infos[i]->album);
+	qsort(infos, nr, sizeof(infos[0]), shuffle_info_cmp);
+
+	/* merge with the old ones, which are in order already */
+	nodes = xnew(struct rb_node *, n + nr);
+	node = rb_first(tree_root);
+	for (i = j = k = 0; node || j < nr; k++) {
+		if (j == nr || (node && compare_rand(node, &infos[j]->tree_node) < 0)) {
+			nodes[k] = node;
+			node = rb_next(node);
+		} else {
+			nodes[k] = &infos[j++]->tree_node;
+		}
+	}
+	rb_build(tree_root, nodes, n + nr);
+	free(nodes);
+}
+
+void shuffle_list_reshuffle(struct rb_root *tree_root)
+{
+	struct shuffle_info **infos;
+	struct rb_node *node;
+	int i = 0, n = rb_count(tree_root);
+
+	infos = xnew(struct shuffle_info *, n);
+	rb_for_each(node, tree_root)
+		infos[i++] = tree_node_to_shuffle_info(node);
+	*tree_root = RB_ROOT;
+	shuffle_list_add_many(infos, n, tree_root);
+	free(infos);
 }
 
 /* expensive */
@@ -37,6 +37,12 @@ struct simple_track {
 	struct list_head node;
 	struct rb_node tree_node;
 	struct track_info *info;
+	/* next track with the same info */
+	struct simple_track *info_next;
+	/* memcmp()-able sort key of info, valid if sort_key_gen is current */
+	char *sort_key;
+	unsigned int sort_key_len;
+	unsigned int sort_key_gen;
 	unsigned int marked : 1;
 };
 
@@ -71,8 +77,15 @@ static inline struct shuffle_info *tree_node_to_shuffle_info(const struct rb_nod
 	return container_of(node, struct shuffle_info, tree_node);
 }
 
-/* NOTE: does not ref ti */
+/*
+ * NOTE: does not ref ti
+ *
+ * links the track to ti->tracks, simple_track_unlink() undoes it
+ */
 void simple_track_init(struct simple_track *track, struct track_info *ti);
+void simple_track_unlink(struct simple_track *track);
+/* moves the track to @ti, refs @ti and unrefs the old info */
+void simple_track_set_info(struct simple_track *track, struct track_info *ti);
 
 /* refs ti */
 struct simple_track *simple_track_new(struct track_info *ti);
@@ -97,10 +110,22 @@ struct simple_track *simple_list_get_next(struct list_head *head, struct simple_
 struct simple_track *simple_list_get_prev(struct list_head *head, struct simple_track *cur,
 		int (*filter)(const struct album *), bool allow_repeat);
 
+/*
+ * @keys_gen must change whenever @keys changes, see sort_keys_gen_new().
+ * Sort keys of the tracks are built lazily and cached until then.
+ */
+unsigned int sort_keys_gen_new(void);
+void simple_track_clear_sort_key(struct simple_track *track);
+
 void sorted_list_add_track(struct list_head *head, struct rb_root *tree_root, struct simple_track *track,
-		const sort_key_t *keys, int tiebreak);
+		const sort_key_t *keys, unsigned int keys_gen, int tiebreak);
 void sorted_list_remove_track(struct list_head *head, struct rb_root *tree_root, struct simple_track *track);
-void sorted_list_rebuild(struct list_head *head, struct rb_root *tree_root, const sort_key_t *keys);
+void sorted_list_rebuild(struct list_head *head, struct rb_root *tree_root, const sort_key_t *keys,
+		unsigned int keys_gen);
+/* like sorted_list_add_track() with tiebreak > 0 for each track, in one pass */
+void sorted_list_add_tracks(struct list_head *head, struct rb_root *tree_root,
+		struct simple_track **tracks, int nr, const sort_key_t *keys,
+		unsigned int keys_gen);
 void rand_list_rebuild(struct list_head *head, struct rb_root *tree_root);
 
 void list_add_rand(struct list_head *head, struct list_head *node, int nr);
@@ -111,6 +136,8 @@ int simple_list_for_each(struct list_head *head, track_info_cb cb,
 		void *data, int reverse);
 
 void shuffle_list_add(struct shuffle_info *track, struct rb_root *tree_root, struct album *album);
+/* the album of each info must be set, reorders @infos */
+void shuffle_list_add_many(struct shuffle_info **infos, int nr, struct rb_root *tree_root);
 void shuffle_list_reshuffle(struct rb_root *tree_root);
 void shuffle_insert(struct rb_root *root, struct shuffle_info *previous, struct shuffle_info *new);
 
@@ -26,6 +26,9 @@
 #include "debug.h"
 #include "path.h"
 #include "ui_curses.h"
+#include "intern.h"
+#include "options.h"
+#include "gbuf.h"
 
 #include <string.h>
 #include <stdatomic.h>
@@ -53,8 +56,11 @@ struct track_info *track_info_new(const char *filename)
 	struct track_info *ti = &priv->ti;
 	ti->uid = uid;
 	ti->filename = xstrdup(filename);
+	ti->tracks = NULL;
 	ti->play_count = 0;
 	ti->comments = NULL;
+	ti->comments_mapped = 0;
+	ti->comments_interned = 0;
 	ti->bpm = -1;
 	ti->codec = NULL;
 	ti->codec_profile = NULL;
@@ -63,11 +69,31 @@ struct track_info *track_info_new(const char *filename)
 	return ti;
 }
 
-void track_info_set_comments(struct track_info *ti, struct keyval *comments) {
+/* collation keys of the same artist, album, genre... are shared */
+static char *intern_collkey(const char *str)
+{
+	char *key, *ret;
+
+	if (!str)
+		return NULL;
+
+	key = u_strcasecoll_key(str);
+	ret = intern_get(key);
+	free(key);
+	return ret;
+}
+
+static void set_comments(struct track_info *ti, struct keyval *comments)
+{
 	long int r128_track_gain;
 	long int r128_album_gain;
 	long int output_gain;
 
+	if (intern_tags && !ti->comments_mapped) {
+		keyvals_intern(comments);
+		ti->comments_interned = 1;
+	}
+
 	ti->comments = comments;
 	ti->artist = keyvals_get_val(comments, "artist");
 	ti->album = keyvals_get_val(comments, "album");
@@ -123,13 +149,46 @@ void track_info_set_comments(struct track_info *ti, struct keyval *comments) {
 	if (comments_get_signed_int(comments, "output_gain", &output_gain) != -1) {
 		ti->output_gain = (output_gain / 256.0);
 	}
+}
+
+void track_info_set_comments(struct track_info *ti, struct keyval *comments)
+{
+	set_comments(ti, comments);
+	ti->collkey_artist = intern_collkey(ti->artist);
+	ti->collkey_album = intern_collkey(ti->album);
+	ti->collkey_title = intern_collkey(ti->title);
+	ti->collkey_genre = intern_collkey(ti->genre);
+	ti->collkey_comment = intern_collkey(ti->comment);
+	ti->collkey_albumartist = intern_collkey(ti->albumartist);
+}
+
+void track_info_set_comments_collkeys(struct track_info *ti, struct keyval *comments,
+		const char * const *collkeys)
+{
+	set_comments(ti, comments);
+	ti->collkey_artist = intern_get0(collkeys[0]);
+	ti->collkey_album = intern_get0(collkeys[1]);
+	ti->collkey_title = intern_get0(collkeys[2]);
+	ti->collkey_genre = intern_get0(collkeys[3]);
+	ti->collkey_comment = intern_get0(collkeys[4]);
+	ti->collkey_albumartist = intern_get0(collkeys[5]);
+}
 
-	ti->collkey_artist = u_strcasecoll_key0(ti->artist);
-	ti->collkey_album = u_strcasecoll_key0(ti->album);
-	ti->collkey_title = u_strcasecoll_key0(ti->title);
-	ti->collkey_genre = u_strcasecoll_key0(ti->genre);
-	ti->collkey_comment = u_strcasecoll_key0(ti->comment);
-	ti->collkey_albumartist = u_strcasecoll_key0(ti->albumartist);
+void track_info_free_comments(struct track_info *ti)
+{
+	if (!ti->comments)
+		return;
+
+	/* only the array is ours, the strings belong to the cache mapping */
+	if (ti->comments_mapped)
+		free(ti->comments);
+	else if (ti->comments_interned)
+		keyvals_free_interned(ti->comments);
+	else
+		keyvals_free(ti->comments);
+	ti->comments = NULL;
+	ti->comments_mapped = 0;
+	ti->comments_interned = 0;
 }
 
 void track_info_ref(struct track_info *ti)
@@ -144,16 +203,16 @@ void track_info_unref(struct track_info *ti)
 	uint32_t prev = atomic_fetch_sub_explicit(&priv->ref_count, 1,
 			memory_order_acq_rel);
 	if (prev == 1) {
-		keyvals_free(ti->comments);
+		track_info_free_comments(ti);
 		free(ti->filename);
 		free(ti->codec);
 		free(ti->codec_profile);
-		free(ti->collkey_artist);
-		free(ti->collkey_album);
-		free(ti->collkey_title);
-		free(ti->collkey_genre);
-		free(ti->collkey_comment);
-		free(ti->collkey_albumartist);
+		intern_put(ti->collkey_artist);
+		intern_put(ti->collkey_album);
+		intern_put(ti->collkey_title);
+		intern_put(ti->collkey_genre);
+		intern_put(ti->collkey_comment);
+		intern_put(ti->collkey_albumartist);
 		free(priv);
 	}
 }
@@ -291,6 +350,118 @@ int track_info_cmp(const struct track_info *a, const struct track_info *b, const
 	return rev ? -res : res;
 }
 
+static void sort_key_add_u64(struct gbuf *buf, uint64_t val, int bytes)
+{
+	while (bytes--)
+		gbuf_add_ch(buf, (char)(val >> (bytes * 8)));
+}
+
+/* NULL before any string, no string is a prefix of another */
+static void sort_key_add_str(struct gbuf *buf, const char *str)
+{
+	if (!str) {
+		gbuf_add_ch(buf, 0);
+		return;
+	}
+	gbuf_add_ch(buf, 1);
+	gbuf_add_str(buf, str);
+	gbuf_add_ch(buf, 0);
+}
+
+/* NaN first, like doublecmp0() */
+static void sort_key_add_double(struct gbuf *buf, double val)
+{
+	uint64_t bits;
+
+	if (val != val) {
+		gbuf_add_ch(buf, 0);
+		return;
+	}
+	/* -0.0 == 0.0 */
+	if (val == 0)
+		val = 0;
+	memcpy(&bits, &val, sizeof(bits));
+	if (bits >> 63)
+		bits = ~bits;
+	else
+		bits |= (uint64_t)1 << 63;
+	gbuf_add_ch(buf, 1);
+	sort_key_add_u64(buf, bits, 8);
+}
+
+static void sort_key_add_filename(struct gbuf *buf, const char *filename,
+		int strcoll_is_strcmp)
+{
+	size_t len;
+	char *key;
+
+	if (strcoll_is_strcmp) {
+		sort_key_add_str(buf, filename);
+		return;
+	}
+
+	len = strxfrm(NULL, filename, 0);
+	key = xnew(char, len + 1);
+	strxfrm(key, filename, len + 1);
+	sort_key_add_str(buf, key);
+	free(key);
+}
+
+void track_info_sort_key(const struct track_info *ti, const sort_key_t *keys,
+		int strcoll_is_strcmp, struct gbuf *buf)
+{
+	int i;
+
+	for (i = 0; keys[i] != SORT_INVALID; i++) {
+		sort_key_t key = keys[i];
+		size_t start = buf->len;
+		int rev = 0;
+
+		if (key >= REV_SORT__START) {
+			rev = 1;
+			key -= REV_SORT__START;
+		}
+
+		switch (key) {
+		case SORT_TRACKNUMBER:
+		case SORT_DISCNUMBER:
+		case SORT_TOTALDISCS:
+		case SORT_DATE:
+		case SORT_ORIGINALDATE:
+		case SORT_PLAY_COUNT:
+		case SORT_BPM:
+		case SORT_DURATION:
+			sort_key_add_u64(buf, (uint32_t)getentry(ti, key, int) ^ 0x80000000U, 4);
+			break;
+		case SORT_FILEMTIME:
+			sort_key_add_u64(buf, (uint64_t)ti->mtime ^ ((uint64_t)1 << 63), 8);
+			break;
+		case SORT_FILENAME:
+			sort_key_add_filename(buf, ti->filename, strcoll_is_strcmp);
+			break;
+		case SORT_RG_TRACK_GAIN:
+		case SORT_RG_TRACK_PEAK:
+		case SORT_RG_ALBUM_GAIN:
+		case SORT_RG_ALBUM_PEAK:
+			sort_key_add_double(buf, getentry(ti, key, double));
+			break;
+		case SORT_BITRATE:
+			sort_key_add_u64(buf, (uint64_t)getentry(ti, key, long) ^ ((uint64_t)1 << 63), 8);
+			break;
+		default:
+			sort_key_add_str(buf, getentry(ti, key, const char *));
+			break;
+		}
+
+		if (rev) {
+			size_t j;
+
+			for (j = start; j < buf->len; j++)
+				buf->buffer[j] = ~buf->buffer[j];
+		}
+	}
+}
+
 static const struct {
 	const char *str;
 	sort_key_t key;
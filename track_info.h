@@ -24,13 +24,20 @@
 #include <stdint.h>
 #include <stdbool.h>
 
+struct gbuf;
+struct simple_track;
+
 struct track_info {
 	uint64_t uid;
 	struct keyval *comments;
 
-	// next track_info in the hash table (cache.c)
+	// replacement after cache_refresh() (cache.c)
 	struct track_info *next;
 
+	// simple_tracks with this info, linked by info_next (track.h)
+	// only used by the main thread
+	struct simple_track *tracks;
+
 	time_t mtime;
 	int duration;
 	long bitrate;
@@ -68,6 +75,10 @@ struct track_info {
 	unsigned int play_count;
 
 	int is_va_compilation : 1;
+	/* keys and values of comments point into the mmap'd cache (cache.c) */
+	unsigned int comments_mapped : 1;
+	/* keys and values of comments are interned (intern.h) */
+	unsigned int comments_interned : 1;
 	int bpm;
 };
 
@@ -134,6 +145,15 @@ typedef size_t sort_key_t;
 struct track_info *track_info_new(const char *filename);
 void track_info_set_comments(struct track_info *ti, struct keyval *comments);
 
+/*
+ * Like track_info_set_comments() but uses precomputed collation keys for
+ * artist, album, title, genre, comment and albumartist, in that order.
+ */
+#define TI_NR_COLLKEYS 6
+void track_info_set_comments_collkeys(struct track_info *ti, struct keyval *comments,
+		const char * const *collkeys);
+void track_info_free_comments(struct track_info *ti);
+
 void track_info_ref(struct track_info *ti);
 void track_info_unref(struct track_info *ti);
 bool track_info_unique_ref(struct track_info *ti);
@@ -165,6 +185,17 @@ int track_info_matches_full(const struct track_info *ti, const char *text, unsig
 
 int track_info_cmp(const struct track_info *a, const struct track_info *b, const sort_key_t *keys);
 
+/*
+ * Appends the sort key of @ti to @buf. memcmp() of the sort keys of two
+ * tracks gives the same order as track_info_cmp() with the same @keys.
+ * The key is binary, not a string.
+ *
+ * @strcoll_is_strcmp is u_strcoll_is_strcmp(), queried once by the caller
+ * rather than for every key since the key may be built on a worker thread.
+ */
+void track_info_sort_key(const struct track_info *ti, const sort_key_t *keys,
+		int strcoll_is_strcmp, struct gbuf *buf);
+
 sort_key_t *parse_sort_keys(const char *value);
 const char *sort_key_to_str(sort_key_t key);
 void sort_keys_to_str(const sort_key_t *keys, char *buf, size_t bufsize);
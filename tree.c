@@ -543,6 +543,8 @@ static struct artist *artist_new(const char *name, const char *sort_name, int is
 	a->collkey_auto_sort_name = u_strcasecoll_key0(a->auto_sort_name);
 	a->expanded = 0;
 	a->is_compilation = is_compilation;
+	a->duration = 0;
+	a->nr_tracks = 0;
 	rb_root_init(&a->album_root);
 
 	return a;
@@ -575,6 +577,8 @@ static struct album *album_new(struct artist *artist, const char *name,
 	album->collkey_sort_name = u_strcasecoll_key0(sort_name);
 	album->date = date;
 	album->min_date = date;
+	album->duration = 0;
+	album->nr_tracks = 0;
 	rb_root_init(&album->track_root);
 	album->artist = artist;
 
@@ -861,6 +865,17 @@ static void add_album(struct album *album)
 	}
 }
 
+static void album_account_track(struct album *album,
+		const struct tree_track *track, int sign)
+{
+	int duration = max_i(0, tree_track_info(track)->duration);
+
+	album->duration += sign * duration;
+	album->nr_tracks += sign;
+	album->artist->duration += sign * duration;
+	album->artist->nr_tracks += sign;
+}
+
 static void album_add_track(struct album *album, struct tree_track *track)
 {
 	/*
@@ -889,6 +904,7 @@ static void album_add_track(struct album *album, struct tree_track *track)
 
 	rb_link_node(&track->tree_node, parent, new);
 	rb_insert_color(&track->tree_node, &album->track_root);
+	album_account_track(album, track, 1);
 }
 
 const char *tree_artist_name(const struct track_info* ti)
@@ -933,14 +949,74 @@ static void remove_artist(struct artist *artist)
 	rb_erase(&artist->tree_node, &lib_artist_root);
 }
 
+/*
+ * Tracks are usually added album by album, from lib.pl or a directory. The
+ * artist and album of the previous track are remembered together with
+ * artist_new() and album_new() of the names they were found by, so that
+ * the next track with the same names doesn't need new collation keys or a
+ * search. The keys are compared again in case the artist or album has
+ * been renamed since.
+ */
+static struct {
+	struct artist *key_artist;
+	struct artist *artist;
+	struct album *key_album;
+	struct album *album;
+} last_found;
+
+static void forget_last_album(void)
+{
+	if (last_found.key_album)
+		album_free(last_found.key_album);
+	last_found.key_album = NULL;
+	last_found.album = NULL;
+}
+
+static void forget_last_artist(void)
+{
+	forget_last_album();
+	if (last_found.key_artist)
+		artist_free(last_found.key_artist);
+	last_found.key_artist = NULL;
+	last_found.artist = NULL;
+}
+
+static struct artist *find_last_artist(const char *name, const char *sort_name,
+		int is_compilation)
+{
+	const struct artist *key = last_found.key_artist;
+	const struct artist *artist = last_found.artist;
+
+	if (!artist || strcmp(key->name, name) || strcmp0(key->sort_name, sort_name) ||
+			key->is_compilation != is_compilation)
+		return NULL;
+	if (special_name_cmp(artist_sort_name(key), artist_sort_collkey(key),
+				artist_sort_name(artist), artist_sort_collkey(artist)))
+		return NULL;
+	return last_found.artist;
+}
+
+static struct album *find_last_album(const struct artist *artist, const char *name,
+		const char *sort_name)
+{
+	const struct album *key = last_found.key_album;
+
+	if (!last_found.album || last_found.album->artist != artist ||
+			strcmp(key->name, name) || strcmp0(key->sort_name, sort_name))
+		return NULL;
+	if (special_album_cmp(key, last_found.album))
+		return NULL;
+	return last_found.album;
+}
+
 void tree_add_track(struct tree_track *track,
 		void (*add_album_cb)(struct album *))
 {
 	const struct track_info *ti = tree_track_info(track);
 	const char *album_name, *artist_name, *artistsort_name = NULL;
 	const char *albumsort_name = NULL;
-	struct artist *artist, *new_artist;
-	struct album *album, *new_album;
+	struct artist *artist, *new_artist = NULL;
+	struct album *album, *new_album = NULL;
 	int date;
 	int is_va_compilation = 0;
 
@@ -960,16 +1036,31 @@ void tree_add_track(struct tree_track *track,
 		is_va_compilation = ti->is_va_compilation;
 	}
 
-	new_artist = artist_new(artist_name, artistsort_name, is_va_compilation);
-	album = NULL;
+	artist = find_last_artist(artist_name, artistsort_name, is_va_compilation);
+	if (!artist) {
+		new_artist = artist_new(artist_name, artistsort_name, is_va_compilation);
+		artist = find_artist(new_artist);
+		if (artist) {
+			forget_last_artist();
+			last_found.key_artist = new_artist;
+			last_found.artist = artist;
+			new_artist = NULL;
+		}
+	}
 
-	artist = find_artist(new_artist);
+	album = NULL;
 	if (artist) {
-		artist_free(new_artist);
-		new_album = album_new(artist, album_name, albumsort_name, date);
-		album = find_album(new_album);
-		if (album)
-			album_free(new_album);
+		album = find_last_album(artist, album_name, albumsort_name);
+		if (!album) {
+			new_album = album_new(artist, album_name, albumsort_name, date);
+			album = find_album(new_album);
+			if (album) {
+				forget_last_album();
+				last_found.key_album = new_album;
+				last_found.album = album;
+				new_album = NULL;
+			}
+		}
 	} else
 		new_album = album_new(new_artist, album_name, albumsort_name, date);
 
@@ -1199,6 +1290,7 @@ static void remove_track(struct tree_track *track)
 		window_row_vanishes(lib_track_win, (struct iter *)&iter);
 	}
 	rb_erase(&track->tree_node, &track->album->track_root);
+	album_account_track(track->album, track, -1);
 }
 
 void tree_remove(struct tree_track *track,
@@ -1227,11 +1319,15 @@ void tree_remove(struct tree_track *track,
 
 		remove_album(album);
 		remove_album_cb(album);
+		if (last_found.album == album)
+			forget_last_album();
 		album_free(album);
 
 		if (rb_root_empty(&artist->album_root)) {
 			artist->expanded = 0;
 			remove_artist(artist);
+			if (last_found.artist == artist)
+				forget_last_artist();
 			artist_free(artist);
 		}
 	}
@@ -23,10 +23,13 @@
 #include "xmalloc.h"
 #include "ui_curses.h" /* using_utf8, charset */
 #include "convert.h"
+#include "utils.h"
+#include "xstrjoin.h"
 
 #include <stdlib.h>
 #include <string.h>
 #include <limits.h>
+#include <locale.h>
 
 int u_strcoll(const char *str1, const char *str2)
 {
@@ -136,3 +139,19 @@ char *u_strcasecoll_key0(const char *str)
 {
 	return str ? u_strcasecoll_key(str) : NULL;
 }
+
+int u_strcoll_is_strcmp(void)
+{
+	const char *name = setlocale(LC_COLLATE, NULL);
+
+	return !strcmp(name, "C") || !strcmp(name, "POSIX") || !strncmp(name, "C.", 2);
+}
+
+uint32_t u_collate_id(void)
+{
+	char *str = xstrjoin(setlocale(LC_COLLATE, NULL), "/", charset);
+	uint32_t id = hash_str(str);
+
+	free(str);
+	return id;
+}
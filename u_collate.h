@@ -19,6 +19,8 @@
 #ifndef CMUS_U_COLLATE_H
 #define CMUS_U_COLLATE_H
 
+#include <stdint.h>
+
 /*
  * @str1  valid, normalized, null-terminated UTF-8 string
  * @str2  valid, normalized, null-terminated UTF-8 string
@@ -74,4 +76,16 @@ char *u_strcasecoll_key(const char *str);
  */
 char *u_strcasecoll_key0(const char *str);
 
+/*
+ * Returns 1 if strcoll() orders like strcmp() in the current LC_COLLATE
+ * locale, so that strxfrm() can be skipped.
+ */
+int u_strcoll_is_strcmp(void);
+
+/*
+ * Identifies the LC_COLLATE locale and charset collation keys are built
+ * for. Keys built under a different id can't be compared to ours.
+ */
+uint32_t u_collate_id(void);
+
 #endif
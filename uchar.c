@@ -597,6 +597,11 @@ static uchar get_base_from_composed(uchar ch)
 	return ch;
 }
 
+uchar u_casefold_base_char(uchar ch)
+{
+	return u_casefold_char(get_base_from_composed(ch));
+}
+
 static inline int do_u_strncase_equal(const char *a, const char *b, size_t len, int only_base_chars)
 {
 	int ai = 0, bi = 0;
@@ -662,6 +667,46 @@ char *u_strcasestr_base(const char *haystack, const char *needle)
 	return do_u_strcasestr(haystack, needle, 1);
 }
 
+static inline uchar get_casefold_base_char(const char *str, int *idx)
+{
+	unsigned char ch = str[*idx];
+
+	/* ASCII has no composed characters */
+	if (ch < 128) {
+		*idx += 1;
+		return u_casefold_char(ch);
+	}
+	return u_casefold_base_char(u_get_char(str, idx));
+}
+
+char *u_strcasestr_base_folded(const char *haystack, const uchar *needle, int needle_len)
+{
+	int idx = 0;
+
+	if (needle_len == 0)
+		return (char *)haystack;
+
+	while (haystack[idx]) {
+		int i = idx, k;
+
+		if (get_casefold_base_char(haystack, &i) == needle[0]) {
+			for (k = 1; k < needle_len; k++) {
+				if (!haystack[i])
+					return NULL;
+				if (get_casefold_base_char(haystack, &i) != needle[k])
+					break;
+			}
+			if (k == needle_len)
+				return (char *)haystack + idx;
+		}
+		if ((unsigned char)haystack[idx] < 128)
+			idx++;
+		else
+			u_get_char(haystack, &idx);
+	}
+	return NULL;
+}
+
 char *u_strcasestr_filename(const char *haystack, const char *needle)
 {
 	char *r = NULL, *ustr = NULL;
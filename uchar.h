@@ -211,6 +211,12 @@ int u_skip_chars(const char *str, int *width, bool overskip);
  */
 char *u_casefold(const char *str);
 
+/*
+ * Returns the case folded base character of @ch. Two characters are equal
+ * for u_strcasestr_base() if this returns the same value for both.
+ */
+uchar u_casefold_base_char(uchar ch);
+
 /*
  * @str1  valid, normalized, null-terminated UTF-8 string
  * @str2  valid, normalized, null-terminated UTF-8 string
@@ -256,6 +262,16 @@ char *u_strcasestr(const char *haystack, const char *needle);
  */
 char *u_strcasestr_base(const char *haystack, const char *needle);
 
+/*
+ * @haystack    valid, normalized, null-terminated UTF-8 string
+ * @needle      characters converted with u_casefold_base_char()
+ * @needle_len  number of characters in @needle
+ *
+ * Like u_strcasestr_base(), but faster if the same needle is searched
+ * for in many strings.
+ */
+char *u_strcasestr_base_folded(const char *haystack, const uchar *needle, int needle_len);
+
 /*
  * @haystack  null-terminated string in local encoding
  * @needle    valid, normalized, null-terminated UTF-8 string
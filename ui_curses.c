@@ -52,6 +52,8 @@
 #include "mpris.h"
 #include "locking.h"
 #include "pl_env.h"
+#include "watch.h"
+#include "profile.h"
 #ifdef HAVE_CONFIG
 #include "config/curses.h"
 #include "config/iconv.h"
@@ -120,6 +122,8 @@ static GBUF(error_buf);
 static time_t error_time = 0;
 /* info messages are displayed in different color */
 static int msg_is_error;
+/* rows the message covers, messages with several lines cover the views */
+static int msg_rows = 1;
 static int error_count = 0;
 
 static char *server_address = NULL;
@@ -274,6 +278,7 @@ enum {
 	TF_DURATION,
 	TF_DURATION_SEC,
 	TF_ALBUMDURATION,
+	TF_TRACKS,
 	TF_BITRATE,
 	TF_CODEC,
 	TF_CODEC_PROFILE,
@@ -334,6 +339,7 @@ static struct format_option track_fopts[NR_TFS + 1] = {
 	DEF_FO_TIME('d', "duration", 0),
 	DEF_FO_INT('\0', "duration_sec", 1),
 	DEF_FO_TIME('\0', "albumduration", 0),
+	DEF_FO_INT('\0', "tracks", 0),
 	DEF_FO_INT('\0', "bitrate", 0),
 	DEF_FO_STR('\0', "codec", 0),
 	DEF_FO_STR('\0', "codec_profile", 0),
@@ -550,6 +556,7 @@ static void fill_track_fopts_track_info(struct track_info *info)
 	fopt_set_str(&track_fopts[TF_COMMENT], info->comment);
 	fopt_set_time(&track_fopts[TF_DURATION], info->duration, info->duration == -1);
 	fopt_set_int(&track_fopts[TF_DURATION_SEC], info->duration, info->duration == -1);
+	fopt_set_int(&track_fopts[TF_TRACKS], 0, 1);
 	fopt_set_double(&track_fopts[TF_RG_TRACK_GAIN], info->rg_track_gain, isnan(info->rg_track_gain));
 	fopt_set_double(&track_fopts[TF_RG_TRACK_PEAK], info->rg_track_peak, isnan(info->rg_track_peak));
 	fopt_set_double(&track_fopts[TF_RG_ALBUM_GAIN], info->rg_album_gain, isnan(info->rg_album_gain));
@@ -582,32 +589,6 @@ static void fill_track_fopts_track_info(struct track_info *info)
 	fopt_set_int(&track_fopts[TF_BPM], info->bpm, info->bpm == -1);
 }
 
-static int get_album_length(struct album *album)
-{
-	struct tree_track *track;
-	struct rb_node *tmp;
-	int duration = 0;
-
-	rb_for_each_entry(track, tmp, &album->track_root, tree_node) {
-		duration += max_i(0, tree_track_info(track)->duration);
-	}
-
-	return duration;
-}
-
-static int get_artist_length(struct artist *artist)
-{
-	struct album *album;
-	struct rb_node *tmp;
-	int duration = 0;
-
-	rb_for_each_entry(album, tmp, &artist->album_root, tree_node) {
-		duration += get_album_length(album);
-	}
-
-	return duration;
-}
-
 static void fill_track_fopts_album(struct album *album)
 {
 	fopt_set_int(&track_fopts[TF_YEAR], album->min_date / 10000, album->min_date <= 0);
@@ -615,9 +596,9 @@ static void fill_track_fopts_album(struct album *album)
 	fopt_set_str(&track_fopts[TF_ALBUMARTIST], album->artist->name);
 	fopt_set_str(&track_fopts[TF_ARTIST], album->artist->name);
 	fopt_set_str(&track_fopts[TF_ALBUM], album->name);
-	int duration = get_album_length(album);
-	fopt_set_time(&track_fopts[TF_DURATION], duration, 0);
-	fopt_set_time(&track_fopts[TF_ALBUMDURATION], duration, 0);
+	fopt_set_time(&track_fopts[TF_DURATION], album->duration, 0);
+	fopt_set_time(&track_fopts[TF_ALBUMDURATION], album->duration, 0);
+	fopt_set_int(&track_fopts[TF_TRACKS], album->nr_tracks, 0);
 }
 
 static void fill_track_fopts_artist(struct artist *artist)
@@ -625,7 +606,8 @@ static void fill_track_fopts_artist(struct artist *artist)
 	const char *name = display_artist_sort_name ? artist_sort_name(artist) : artist->name;
 	fopt_set_str(&track_fopts[TF_ARTIST], name);
 	fopt_set_str(&track_fopts[TF_ALBUMARTIST], name);
-	fopt_set_time(&track_fopts[TF_DURATION], get_artist_length(artist), 0);
+	fopt_set_time(&track_fopts[TF_DURATION], artist->duration, 0);
+	fopt_set_int(&track_fopts[TF_TRACKS], artist->nr_tracks, 0);
 }
 
 const struct format_option *get_global_fopts(void)
@@ -1277,12 +1259,38 @@ static void dump_buffer(const char *buffer)
 	}
 }
 
+/* draws the message up from the command line, the last lines if not all fit */
+static void dump_msg(void)
+{
+	const char *line = error_buf.buffer;
+	const char *s;
+	int lines = 1, row;
+
+	for (s = line; (s = strchr(s, '\n')); s++)
+		lines++;
+	msg_rows = min_i(lines, LINES);
+	for (; lines > msg_rows; lines--)
+		line = strchr(line, '\n') + 1;
+
+	for (row = LINES - msg_rows; row < LINES; row++) {
+		const char *end = strchr(line, '\n');
+
+		if (!end)
+			end = line + strlen(line);
+		move(row, 0);
+		addnstr(line, end - line);
+		clrtoeol();
+		line = end + 1;
+	}
+}
+
 static void do_update_commandline(void)
 {
 	char *str;
 	size_t idx = 0;
 	char ch;
 
+	msg_rows = 1;
 	move(LINES - 1, 0);
 	if (error_buf.len != 0) {
 		if (msg_is_error) {
@@ -1290,8 +1298,7 @@ static void do_update_commandline(void)
 		} else {
 			bkgdset(pairs[CURSED_INFO]);
 		}
-		addstr(error_buf.buffer);
-		clrtoeol();
+		dump_msg();
 		return;
 	}
 	bkgdset(pairs[CURSED_COMMANDLINE]);
@@ -1428,6 +1435,10 @@ static void do_update_titleline(void)
 
 static void post_update(void)
 {
+	/* keep a message with several lines on top of what was just drawn */
+	if (msg_rows > 1)
+		do_update_commandline();
+
 	/* refresh makes cursor visible at least for urxvt */
 	if (input_mode == COMMAND_MODE || input_mode == SEARCH_MODE) {
 		move(LINES - 1, cmdline_cursor_x);
@@ -1503,6 +1514,12 @@ void update_full(void)
 
 static void update_commandline(void)
 {
+	/* the views under the previous message must be drawn again */
+	if (msg_rows > 1) {
+		update_full();
+		return;
+	}
+
 	curs_set(0);
 	do_update_commandline();
 	post_update();
@@ -2231,6 +2248,7 @@ static void main_loop(void)
 		fd_set set;
 		struct timeval tv;
 		int poll_mixer = 0;
+		int watch_ms;
 		int i;
 		int nr_fds_vol = 0, fds_vol[NR_MIXER_FDS];
 		int nr_fds_out = 0, fds_out[NR_MIXER_FDS];
@@ -2238,6 +2256,7 @@ static void main_loop(void)
 		struct client *client;
 
 		player_info_snapshot();
+		player_save_play_counts();
 
 		update();
 
@@ -2262,6 +2281,8 @@ static void main_loop(void)
 		SELECT_ADD_FD(job_fd);
 		SELECT_ADD_FD(cmus_next_track_request_fd);
 		SELECT_ADD_FD(server_socket);
+		if (watch_fd != -1)
+			SELECT_ADD_FD(watch_fd);
 		if (mpris_fd != -1)
 			SELECT_ADD_FD(mpris_fd);
 		list_for_each_entry(client, &client_head, node) {
@@ -2286,7 +2307,14 @@ static void main_loop(void)
 			SELECT_ADD_FD(fds_out[i]);
 		}
 
-		rc = select(fd_high + 1, &set, NULL, NULL, tv.tv_usec ? &tv : NULL);
+		watch_ms = watch_poll();
+		if (watch_ms >= 0 && (!tv.tv_usec || watch_ms * 1000 < tv.tv_usec)) {
+			watch_ms = max_i(watch_ms, 1);
+			tv.tv_sec = watch_ms / 1000;
+			tv.tv_usec = watch_ms % 1000 * 1000;
+		}
+
+		rc = select(fd_high + 1, &set, NULL, NULL, tv.tv_sec || tv.tv_usec ? &tv : NULL);
 		if (poll_mixer) {
 			int ol = volume_l;
 			int or = volume_r;
@@ -2347,6 +2375,9 @@ static void main_loop(void)
 		if (FD_ISSET(job_fd, &set))
 			job_handle();
 
+		if (watch_fd != -1 && FD_ISSET(watch_fd, &set))
+			watch_handle();
+
 		if (FD_ISSET(cmus_next_track_request_fd, &set))
 			cmus_provide_next_track();
 	}
@@ -2439,15 +2470,70 @@ static void init_curses(void)
 	update_window_size();
 }
 
+static uint64_t lib_load_start;
+static struct track_info **lib_load_tis;
+static int lib_load_nr, lib_load_alloc;
+/* lib.pl is being read, cleared when it is done or the load is cancelled */
+static int lib_loading;
+
+static void lib_load_free(void)
+{
+	int i;
+
+	for (i = 0; i < lib_load_nr; i++)
+		track_info_unref(lib_load_tis[i]);
+	free(lib_load_tis);
+	lib_load_tis = NULL;
+	lib_load_nr = lib_load_alloc = 0;
+}
+
+/* the library is built in one go when the whole lib.pl has been read */
+static void lib_autosave_add_track(struct track_info *ti, void *opaque)
+{
+	/* results of a cancelled load may still arrive */
+	if (!lib_loading)
+		return;
+
+	if (ti) {
+		if (lib_load_nr == lib_load_alloc) {
+			lib_load_alloc = lib_load_alloc ? lib_load_alloc * 2 : 1024;
+			lib_load_tis = xrenew(struct track_info *, lib_load_tis, lib_load_alloc);
+		}
+		/* unreferenced by the caller when we return */
+		track_info_ref(ti);
+		lib_load_tis[lib_load_nr++] = ti;
+		return;
+	}
+
+	/* end of lib.pl */
+	lib_add_tracks(lib_load_tis, lib_load_nr);
+	lib_load_free();
+	lib_loading = 0;
+	profile_phase("lib_load", lib_load_start);
+	profile_total("ready");
+}
+
+void lib_autosave_cancel(void)
+{
+	lib_load_free();
+	lib_loading = 0;
+}
+
 static void init_all(void)
 {
+	uint64_t t;
+
 	main_thread = pthread_self();
 	cmus_track_request_init();
 
+	t = profile_get();
 	server_init(server_address);
+	profile_phase("server_init", t);
 
 	/* does not select output plugin */
+	t = profile_get();
 	player_init();
+	profile_phase("player_init", t);
 
 	/* plugins have been loaded so we know what plugin options are available */
 	options_add();
@@ -2467,15 +2553,19 @@ static void init_all(void)
 	search_mode_init();
 
 	/* almost everything must be initialized now */
+	t = profile_get();
 	options_load();
+	profile_phase("options_load", t);
 	pl_init_options();
 	if (mpris)
 		mpris_init();
 
 	/* finally we can set the output plugin */
+	t = profile_get();
 	player_set_op(output_plugin);
 	if (!soft_vol || pause_on_output_change)
 		mixer_open();
+	profile_phase("output_open", t);
 
 	lib_autosave_filename = xstrjoin(cmus_config_dir, "/lib.pl");
 	play_queue_autosave_filename = xstrjoin(cmus_config_dir, "/queue.pl");
@@ -2492,59 +2582,81 @@ static void init_all(void)
 	}
 	help_add_all_unbound();
 
+	t = profile_get();
 	init_curses();
+	profile_phase("init_curses", t);
 
 	// enable bracketed paste (will be ignored if not supported)
 	printf("\033[?2004h");
 	fflush(stdout);
 
 	if (resume_cmus) {
+		t = profile_get();
 		resume_load();
+		profile_phase("resume_load", t);
 		cmus_add(play_queue_append, play_queue_autosave_filename,
 				FILE_TYPE_PL, JOB_TYPE_QUEUE, 0, NULL);
 	} else {
 		set_view(start_view);
 	}
 
-	cmus_add(lib_add_track, lib_autosave_filename, FILE_TYPE_PL,
+	lib_load_start = profile_get();
+	lib_loading = 1;
+	cmus_add(lib_autosave_add_track, lib_autosave_filename, FILE_TYPE_PL,
 			JOB_TYPE_LIB, 0, NULL);
 
 	worker_start();
+	profile_total("startup");
 }
 
 static void exit_all(void)
 {
+	uint64_t start = profile_get();
+	uint64_t t;
+
 	endwin();
 
 	// disable bracketed paste
 	printf("\033[?2004l");
 	fflush(stdout);
 
+	t = profile_get();
 	if (resume_cmus)
 		resume_exit();
 	options_exit();
+	profile_phase("options_exit", t);
+	watch_exit();
 
 	server_exit();
+	player_save_play_counts();
 	cmus_exit();
+	t = profile_get();
 	if (resume_cmus)
 		cmus_save(play_queue_for_each, play_queue_autosave_filename,
 				NULL);
-	cmus_save(lib_for_each, lib_autosave_filename, NULL);
+	/* the library is empty until lib.pl has been read completely */
+	if (!lib_loading)
+		cmus_save(lib_for_each, lib_autosave_filename, NULL);
+	profile_phase("lib_save", t);
 
 	pl_exit();
+	t = profile_get();
 	player_exit();
 	op_exit_plugins();
+	profile_phase("player_exit", t);
 	commands_exit();
 	search_mode_exit();
 	filters_exit();
 	help_exit();
 	browser_exit();
 	mpris_free();
+	profile_phase("shutdown", start);
 }
 
 enum {
 	FLAG_LISTEN,
 	FLAG_PLUGINS,
+	FLAG_PROFILE,
 	FLAG_SHOW_CURSOR,
 	FLAG_HELP,
 	FLAG_VERSION,
@@ -2554,6 +2666,7 @@ enum {
 static struct option options[NR_FLAGS + 1] = {
 	{ 0, "listen", 1 },
 	{ 0, "plugins", 0 },
+	{ 0, "profile", 1 },
 	{ 0, "show-cursor", 0 },
 	{ 0, "help", 0 },
 	{ 0, "version", 0 },
@@ -2568,6 +2681,7 @@ static const char *usage =
 "                      ADDR is either a UNIX socket or host[:port]\n"
 "                      WARNING: using TCP/IP is insecure!\n"
 "      --plugins       list available plugins and exit\n"
+"      --profile FILE  write startup and shutdown timings to FILE\n"
 "      --show-cursor   always visible cursor\n"
 "      --help          display this help and exit\n"
 "      --version       " VERSION "\n"
@@ -2578,6 +2692,8 @@ static const char *usage =
 int main(int argc, char *argv[])
 {
 	int list_plugins = 0;
+	const char *profile_filename = NULL;
+	uint64_t t;
 
 	program_name = argv[0];
 	argv++;
@@ -2601,6 +2717,9 @@ int main(int argc, char *argv[])
 		case FLAG_PLUGINS:
 			list_plugins = 1;
 			break;
+		case FLAG_PROFILE:
+			profile_filename = arg;
+			break;
 		case FLAG_LISTEN:
 			server_address = xstrdup(arg);
 			break;
@@ -2627,10 +2746,13 @@ int main(int argc, char *argv[])
 	if (server_address == NULL)
 		server_address = xstrdup(cmus_socket_path);
 	debug_init();
+	profile_init(profile_filename);
 	d_print("charset = '%s'\n", charset);
 
+	t = profile_get();
 	ip_load_plugins();
 	op_load_plugins();
+	profile_phase("load_plugins", t);
 	if (list_plugins) {
 		ip_dump_plugins();
 		op_dump_plugins();
@@ -2639,6 +2761,7 @@ int main(int argc, char *argv[])
 	init_all();
 	main_loop();
 	exit_all();
+	profile_exit();
 	spawn_status_program_inner("exiting", NULL);
 	return 0;
 }
@@ -78,4 +78,7 @@ const struct format_option *get_global_fopts(void);
 
 int get_track_win_x(void);
 
+/* call after cancelling JOB_TYPE_LIB, drops the tracks of lib.pl read so far */
+void lib_autosave_cancel(void);
+
 #endif
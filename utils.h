@@ -164,6 +164,19 @@ static inline uint32_t hash_str(const char *s)
 	return h ^ (h >> 16);
 }
 
+static inline uint32_t hash_u64(uint64_t x)
+{
+	x ^= x >> 33;
+	x *= 0xff51afd7ed558ccdULL;
+	x ^= x >> 33;
+	return x;
+}
+
+static inline uint32_t hash_ptr(const void *ptr)
+{
+	return hash_u64((uintptr_t)ptr);
+}
+
 static inline time_t file_get_mtime(const char *filename)
 {
 	struct stat s;
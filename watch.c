@@ -0,0 +1,342 @@
+/*
+ * Copyright 2026 Various Authors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "watch.h"
+#include "hashtable.h"
+#include "options.h"
+#include "cmus.h"
+#include "lib.h"
+#include "job.h"
+#include "worker.h"
+#include "path.h"
+#include "xmalloc.h"
+#include "xstrjoin.h"
+#include "utils.h"
+#include "debug.h"
+#include "config/watch.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#ifdef HAVE_INOTIFY
+#include <sys/inotify.h>
+#endif
+
+/* events are collected for this long before the update job is scheduled */
+#define WATCH_DELAY_MS		1000
+/* interval of the periodic check when not watching */
+#define WATCH_SWEEP_MS		(15 * 60 * 1000)
+
+struct watch_dir {
+	int wd;
+	uint32_t hash;
+	char path[];
+};
+
+int watch_fd = -1;
+
+/* watch_dirs keyed by path and by wd */
+static struct hashtable dirs_by_path = HASHTABLE_INIT;
+static struct hashtable dirs_by_wd = HASHTABLE_INIT;
+
+/* library tracks with pending events, each has a ref */
+static struct track_info **pending;
+static int nr_pending;
+static int alloc_pending;
+static uint64_t pending_since;
+
+/* the whole library needs to be checked (overflow, directory gone) */
+static int need_sweep;
+/* watching is not possible, check the library periodically */
+static int sweeping;
+static uint64_t last_sweep;
+
+static uint64_t now_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static bool dir_path_eq(const void *ptr, const void *key)
+{
+	const struct watch_dir *d = ptr;
+
+	return !strcmp(d->path, key);
+}
+
+static bool dir_wd_eq(const void *ptr, const void *key)
+{
+	const struct watch_dir *d = ptr;
+
+	return d->wd == *(const int *)key;
+}
+
+static void free_dirs(void)
+{
+	struct hashtable_iter iter;
+	struct watch_dir *d;
+
+	hashtable_iter_init(&iter, &dirs_by_path);
+	while ((d = hashtable_iter_next(&iter)))
+		free(d);
+	hashtable_clear(&dirs_by_path);
+	hashtable_clear(&dirs_by_wd);
+}
+
+static void clear_pending(void)
+{
+	int i;
+
+	for (i = 0; i < nr_pending; i++)
+		track_info_unref(pending[i]);
+	free(pending);
+	pending = NULL;
+	nr_pending = 0;
+	alloc_pending = 0;
+}
+
+static void stop_watching(void)
+{
+	if (watch_fd != -1) {
+		close(watch_fd);
+		watch_fd = -1;
+	}
+	free_dirs();
+	clear_pending();
+}
+
+static void start_sweeping(const char *reason)
+{
+	d_print("not watching the library: %s\n", reason);
+	stop_watching();
+	sweeping = 1;
+	last_sweep = now_ms();
+}
+
+static int add_track_cb(void *data, struct track_info *ti)
+{
+	watch_add_track(ti->filename);
+	return 0;
+}
+
+void watch_reset(void)
+{
+	stop_watching();
+	sweeping = 0;
+	need_sweep = 0;
+
+	if (!watch_library)
+		return;
+
+#ifdef HAVE_INOTIFY
+	watch_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (watch_fd == -1) {
+		start_sweeping(strerror(errno));
+		return;
+	}
+	lib_for_each(add_track_cb, NULL, NULL);
+#else
+	start_sweeping("inotify not supported");
+#endif
+}
+
+void watch_exit(void)
+{
+	stop_watching();
+}
+
+void watch_add_track(const char *filename)
+{
+#ifdef HAVE_INOTIFY
+	struct watch_dir *d;
+	uint32_t hash;
+	char *path;
+	int wd;
+
+	if (watch_fd == -1 || is_url(filename))
+		return;
+
+	path = path_dirname(filename);
+	hash = hash_str(path);
+	if (hashtable_find(&dirs_by_path, hash, dir_path_eq, path)) {
+		free(path);
+		return;
+	}
+
+	if (hashtable_count(&dirs_by_path) >= watch_limit) {
+		free(path);
+		start_sweeping("watch_limit reached");
+		return;
+	}
+
+	wd = inotify_add_watch(watch_fd, path, IN_ATTRIB | IN_CLOSE_WRITE |
+			IN_MOVED_TO | IN_MOVED_FROM | IN_DELETE |
+			IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR);
+	if (wd == -1) {
+		int err = errno;
+
+		d_print("inotify_add_watch %s: %s\n", path, strerror(err));
+		free(path);
+		// out of watches or memory, other errors only affect this directory
+		if (err == ENOSPC || err == ENOMEM)
+			start_sweeping(strerror(err));
+		return;
+	}
+
+	// different paths can refer to the same directory
+	if (!hashtable_find(&dirs_by_wd, wd, dir_wd_eq, &wd)) {
+		d = xmalloc(sizeof(*d) + strlen(path) + 1);
+		d->wd = wd;
+		d->hash = hash;
+		strcpy(d->path, path);
+		hashtable_insert(&dirs_by_path, hash, d);
+		hashtable_insert(&dirs_by_wd, wd, d);
+	}
+	free(path);
+#endif
+}
+
+static void add_pending(struct track_info *ti)
+{
+	int i;
+
+	for (i = nr_pending - 1; i >= 0 && i >= nr_pending - 16; i--) {
+		// usually several events for the same file in a row
+		if (pending[i] == ti)
+			return;
+	}
+
+	if (!nr_pending)
+		pending_since = now_ms();
+	if (nr_pending == alloc_pending) {
+		alloc_pending = alloc_pending ? alloc_pending * 2 : 64;
+		pending = xrenew(struct track_info *, pending, alloc_pending);
+	}
+	track_info_ref(ti);
+	pending[nr_pending++] = ti;
+}
+
+#ifdef HAVE_INOTIFY
+static void remove_dir(struct watch_dir *d)
+{
+	hashtable_remove(&dirs_by_path, d->hash, d);
+	hashtable_remove(&dirs_by_wd, d->wd, d);
+	free(d);
+}
+
+static void handle_event(const struct inotify_event *ev)
+{
+	struct watch_dir *d;
+	struct track_info *ti;
+	char *filename;
+
+	if (ev->mask & IN_Q_OVERFLOW) {
+		need_sweep = 1;
+		return;
+	}
+
+	d = hashtable_find(&dirs_by_wd, ev->wd, dir_wd_eq, &ev->wd);
+	if (!d)
+		return;
+
+	if (ev->mask & IN_IGNORED) {
+		// removed, unmounted or moved away, tracks in it are gone
+		remove_dir(d);
+		need_sweep = 1;
+		return;
+	}
+	if (ev->mask & (IN_DELETE_SELF | IN_MOVE_SELF)) {
+		need_sweep = 1;
+		return;
+	}
+	if (!ev->len || (ev->mask & IN_ISDIR))
+		return;
+
+	filename = xstrjoin(d->path, "/", ev->name);
+	ti = lib_find_ti(filename);
+	if (ti)
+		add_pending(ti);
+	free(filename);
+}
+#endif
+
+void watch_handle(void)
+{
+#ifdef HAVE_INOTIFY
+	char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+	ssize_t len;
+
+	while ((len = read(watch_fd, buf, sizeof(buf))) > 0) {
+		char *ptr = buf;
+
+		while (ptr < buf + len) {
+			const struct inotify_event *ev = (void *)ptr;
+
+			handle_event(ev);
+			ptr += sizeof(*ev) + ev->len;
+		}
+	}
+#endif
+}
+
+static void schedule_sweep(void)
+{
+	// one at a time is enough
+	if (!worker_has_job_by_type(JOB_TYPE_UPDATE))
+		cmus_update_lib();
+}
+
+int watch_poll(void)
+{
+	uint64_t now;
+	int ms;
+
+	if (!nr_pending && !need_sweep && !sweeping)
+		return -1;
+
+	now = now_ms();
+	if (need_sweep) {
+		need_sweep = 0;
+		clear_pending();
+		schedule_sweep();
+	}
+
+	if (nr_pending) {
+		if (now - pending_since < WATCH_DELAY_MS)
+			return WATCH_DELAY_MS - (now - pending_since);
+
+		d_print("%d files changed\n", nr_pending);
+		cmus_update_tis(pending, nr_pending, 0);
+		pending = NULL;
+		nr_pending = 0;
+		alloc_pending = 0;
+	}
+
+	if (!sweeping)
+		return -1;
+
+	if (now - last_sweep >= WATCH_SWEEP_MS) {
+		schedule_sweep();
+		last_sweep = now;
+	}
+	ms = WATCH_SWEEP_MS - (now - last_sweep);
+	return ms;
+}
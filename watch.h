@@ -0,0 +1,50 @@
+/*
+ * Copyright 2026 Various Authors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CMUS_WATCH_H
+#define CMUS_WATCH_H
+
+/*
+ * Watches the directories of library tracks with inotify and schedules
+ * update jobs for the files that changed. Without inotify, or with more
+ * directories than watch_limit, the whole library is checked every few
+ * minutes instead.
+ *
+ * Everything here runs in the main thread.
+ */
+
+/* inotify fd for the main loop, -1 if not watching */
+extern int watch_fd;
+
+void watch_exit(void);
+
+/* called when watch_library or watch_limit changes */
+void watch_reset(void);
+
+/* starts watching the directory of a track added to the library */
+void watch_add_track(const char *filename);
+
+/* reads events from watch_fd */
+void watch_handle(void);
+
+/*
+ * Schedules update jobs which are due. Returns the number of milliseconds
+ * until it should be called again or -1 if there is nothing to do.
+ */
+int watch_poll(void);
+
+#endif
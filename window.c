@@ -38,6 +38,24 @@ static int selectable(struct window *win, struct iter *iter)
 	return 1;
 }
 
+/* index of the row @iter points to, @iter must be a real row */
+static int row_index(struct window *win, struct iter *iter)
+{
+	struct iter tmp;
+	int index = 0;
+
+	if (win->get_index)
+		return win->get_index(iter);
+
+	tmp = win->head;
+	win->get_next(&tmp);
+	while (!iters_equal(&tmp, iter)) {
+		BUG_ON(!win->get_next(&tmp));
+		index++;
+	}
+	return index;
+}
+
 struct window *window_new(int (*get_prev)(struct iter *), int (*get_next)(struct iter *))
 {
 	struct window *win;
@@ -47,6 +65,9 @@ struct window *window_new(int (*get_prev)(struct iter *), int (*get_next)(struct
 	win->get_prev = get_prev;
 	win->selectable = NULL;
 	win->sel_changed = NULL;
+	win->get_index = NULL;
+	win->set_index = NULL;
+	win->get_count = NULL;
 	win->nr_rows = 1;
 	win->changed = 1;
 	iter_init(&win->head);
@@ -226,17 +247,25 @@ void window_changed(struct window *win)
 	/* make sure the selected row is visible */
 
 	/* get distance between top and sel */
-	delta = 0;
-	iter = win->top;
-	while (!iters_equal(&iter, &win->sel)) {
-		if (!win->get_next(&iter)) {
-			/* sel < top, scroll up until top == sel */
-			while (!iters_equal(&win->top, &win->sel))
-				win->get_prev(&win->top);
+	if (win->get_index && !iter_is_head(&win->sel)) {
+		delta = win->get_index(&win->sel) - win->get_index(&win->top);
+		if (delta < 0) {
+			win->top = win->sel;
 			delta = 0;
-			break;
 		}
-		delta++;
+	} else {
+		delta = 0;
+		iter = win->top;
+		while (!iters_equal(&iter, &win->sel)) {
+			if (!win->get_next(&iter)) {
+				/* sel < top, scroll up until top == sel */
+				while (!iters_equal(&win->top, &win->sel))
+					win->get_prev(&win->top);
+				delta = 0;
+				break;
+			}
+			delta++;
+		}
 	}
 
 	/* scroll down if needed to make sel visible at bottom, and a bit
@@ -368,21 +397,8 @@ void window_set_sel(struct window *win, struct iter *iter)
 		return;
 	win->sel = *iter;
 
-	tmp = win->head;
-	win->get_next(&tmp);
-	top_nr = 0;
-	while (!iters_equal(&tmp, &win->top)) {
-		win->get_next(&tmp);
-		top_nr++;
-	}
-
-	tmp = win->head;
-	win->get_next(&tmp);
-	sel_nr = 0;
-	while (!iters_equal(&tmp, &win->sel)) {
-		BUG_ON(!win->get_next(&tmp));
-		sel_nr++;
-	}
+	top_nr = row_index(win, &win->top);
+	sel_nr = row_index(win, &win->sel);
 
 	upper_bound = win->nr_rows / 2;
 	if (scroll_offset < upper_bound)
@@ -628,3 +644,61 @@ int window_get_nr_rows(struct window *win)
 {
 	return win->nr_rows;
 }
+
+int window_get_sel_index(struct window *win)
+{
+	if (iter_is_empty(&win->sel))
+		return -1;
+	return row_index(win, &win->sel);
+}
+
+int window_get_count(struct window *win)
+{
+	struct iter iter;
+	int count = 0;
+
+	if (iter_is_null(&win->head))
+		return 0;
+	if (win->get_count)
+		return win->get_count(&win->head);
+
+	iter = win->head;
+	while (win->get_next(&iter))
+		count++;
+	return count;
+}
+
+void window_goto_index(struct window *win, int index)
+{
+	struct iter iter = win->head;
+	int count = window_get_count(win);
+
+	if (!count)
+		return;
+	index = clamp(index, 0, count - 1);
+
+	if (win->set_index) {
+		BUG_ON(!win->set_index(&iter, index));
+	} else {
+		win->get_next(&iter);
+		while (index--)
+			win->get_next(&iter);
+	}
+
+	/* like window_row_vanishes(), prefer the next selectable row */
+	if (!selectable(win, &iter)) {
+		struct iter tmp = iter;
+
+		while (win->get_next(&tmp) && !selectable(win, &tmp))
+			;
+		if (iter_is_head(&tmp)) {
+			tmp = iter;
+			while (win->get_prev(&tmp) && !selectable(win, &tmp))
+				;
+			if (iter_is_head(&tmp))
+				return;
+		}
+		iter = tmp;
+	}
+	window_set_sel(win, &iter);
+}
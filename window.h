@@ -57,6 +57,18 @@ struct window {
 	/* NULL if all rows are selectable */
 	int (*selectable)(struct iter *iter);
 	void (*sel_changed)(void);
+
+	/*
+	 * optional, NULL if rows can only be counted by walking them
+	 *
+	 * get_index() returns the index of the row @iter points to.
+	 * set_index() stores row @index of the list @iter->data0 to @iter,
+	 * returns 0 if there is no such row.
+	 * get_count() returns the number of rows in the list @head->data0.
+	 */
+	int (*get_index)(struct iter *iter);
+	int (*set_index)(struct iter *iter, int index);
+	int (*get_count)(struct iter *head);
 };
 
 struct window *window_new(int (*get_prev)(struct iter *), int (*get_next)(struct iter *));
@@ -101,4 +113,10 @@ void window_page_middle(struct window *win);
 
 int window_get_nr_rows(struct window *win);
 
+/* index of the selected row, -1 if the window is empty */
+int window_get_sel_index(struct window *win);
+int window_get_count(struct window *win);
+/* selects the selectable row nearest to @index, which is clamped */
+void window_goto_index(struct window *win, int index);
+
 #endif
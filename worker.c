@@ -217,7 +217,8 @@ int worker_has_job_by_cb(worker_match_cb cb, void *opaque)
 }
 
 /*
- * this is only called from the worker thread
+ * this is only called from the worker thread or from threads started by
+ * the current job
  * cur_job is guaranteed to be non-NULL
  */
 int worker_cancelling(void)